@@ -0,0 +1,15 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Allocations.hpp"
+
+
+namespace bench
+{
+
+void report_allocations( benchmark::State& state, const size_t before )
+{
+    state.counters["allocs/op"] = benchmark::Counter(
+        static_cast< double >( heap_allocations() - before ), benchmark::Counter::kAvgIterations );
+}
+
+} // namespace bench
@@ -0,0 +1,18 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_BENCH_ALLOCATIONS_HPP
+#define METAL_BENCH_ALLOCATIONS_HPP
+
+#include "tests/Allocations.hpp"
+#include <benchmark/benchmark.h>
+
+
+namespace bench
+{
+
+/** Report the average number of heap allocations per iteration since the given count */
+void report_allocations( benchmark::State& state, size_t before );
+
+} // namespace bench
+
+#endif
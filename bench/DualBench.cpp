@@ -0,0 +1,101 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Arena.hpp"
+#include "metal/Dual.hpp"
+#include "metal/Directions.hpp"
+#include "metal/ScalarGradient.hpp"
+#include "Allocations.hpp"
+
+#include <cmath>
+#include <benchmark/benchmark.h>
+
+
+namespace
+{
+
+template< typename T >
+auto foo( const T& x, const T& y )
+{
+    return 2 * M_PI * sqrt( cube( x ) / y ) + sin( x ) * cos( y );
+}
+
+/** Evaluate with the given derivatives of the inputs, resetting the arena of the current scope if any */
+template< typename Deriv >
+void eval( benchmark::State& state, const Deriv& dx, const Deriv& dy, metal::Arena* arena = nullptr )
+{
+    double x = 1.5;
+    double y = 2.0;
+    const auto before = heap_allocations();
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( x );
+        benchmark::DoNotOptimize( y );
+        {
+            const metal::Dual< double, Deriv > u{ x, dx };
+            const metal::Dual< double, Deriv > v{ y, dy };
+            benchmark::DoNotOptimize( foo( u, v ) );
+        }
+        if ( arena )
+        {
+            arena->reset();
+        }
+    }
+    bench::report_allocations( state, before );
+}
+
+} // namespace
+
+
+void BM_DualScalar( benchmark::State& state )
+{
+    eval( state, 1.0, 0.0 );
+}
+
+void BM_DualDirections( benchmark::State& state )
+{
+    using Deriv = metal::Directions< double, 4 >;
+    eval( state, Deriv::unit( 0 ), Deriv::unit( 1 ) );
+}
+
+void BM_DualFixedGradient( benchmark::State& state )
+{
+    const metal::Parameter p1;
+    const metal::Parameter p2;
+    using Deriv = metal::Gradient< double, 2 >;
+    eval( state, Deriv{ { p1, p2 }, { 1.0, 0.0 } }, Deriv{ { p1, p2 }, { 0.0, 1.0 } } );
+}
+
+void BM_DualDynamicGradient( benchmark::State& state )
+{
+    const metal::Parameter p1;
+    const metal::Parameter p2;
+    using Deriv = metal::Gradient< double, -1 >;
+    eval( state, Deriv{ { p1 }, { 1.0 } }, Deriv{ { p2 }, { 1.0 } } );
+}
+
+void BM_DualDynamicGradientArena( benchmark::State& state )
+{
+    const metal::Parameter p1;
+    const metal::Parameter p2;
+    using Deriv = metal::Gradient< double, -1 >;
+    metal::Arena arena;
+    const metal::ArenaScope scope{ arena };
+    eval( state, Deriv{ { p1 }, { 1.0 } }, Deriv{ { p2 }, { 1.0 } }, &arena );
+}
+
+void BM_DualInlineGradient( benchmark::State& state )
+{
+    const metal::Parameter p1;
+    const metal::Parameter p2;
+    using Deriv = metal::Gradient< double, -1, 2 >;
+    eval( state, Deriv{ { p1 }, { 1.0 } }, Deriv{ { p2 }, { 1.0 } } );
+}
+
+BENCHMARK( BM_DualScalar );
+BENCHMARK( BM_DualDirections );
+BENCHMARK( BM_DualFixedGradient );
+BENCHMARK( BM_DualDynamicGradient );
+BENCHMARK( BM_DualDynamicGradientArena );
+BENCHMARK( BM_DualInlineGradient );
+
+BENCHMARK_MAIN();
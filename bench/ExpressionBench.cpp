@@ -0,0 +1,115 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Core.hpp"
+#include "Allocations.hpp"
+
+#include <cmath>
+#include <benchmark/benchmark.h>
+
+
+namespace
+{
+
+constexpr auto foo( auto x, auto y )
+{
+    return 2 * M_PI * sqrt( cube( x ) / y );
+}
+
+constexpr auto period( auto sma, auto gm )
+{
+    return metal::TwoPi{} * sqrt( cube( sma ) / gm );
+}
+
+template< int Order, typename Expr, typename Var >
+constexpr auto derivative( const Expr& expr, const Var& var )
+{
+    if constexpr ( Order == 0 )
+    {
+        return expr;
+    }
+    else
+    {
+        return derivative< Order - 1 >( diff( expr, var ), var );
+    }
+}
+
+// The inputs go through memory on every iteration so the evaluation cannot be folded or hoisted
+template< typename Expr >
+void eval( benchmark::State& state, const Expr& expr, double x, double y )
+{
+    const auto before = heap_allocations();
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( x );
+        benchmark::DoNotOptimize( y );
+        const metal::Bindings point{ metal::bind< "x" >( x ), metal::bind< "y" >( y ) };
+        benchmark::DoNotOptimize( expr.eval( point ) );
+    }
+    bench::report_allocations( state, before );
+    state.counters["ops/eval"] = metal::count_ops( expr ).total();
+}
+
+} // namespace
+
+
+template< int Order >
+void BM_FooDerivative( benchmark::State& state )
+{
+    const metal::Double< "x" > x;
+    const metal::Double< "y" > y;
+    eval( state, derivative< Order >( foo( x, y ), x ), 1.5, 2.0 );
+}
+
+template< int Order >
+void BM_FooDerivativeCse( benchmark::State& state )
+{
+    const metal::Double< "x" > x;
+    const metal::Double< "y" > y;
+    eval( state, metal::cse( derivative< Order >( foo( x, y ), x ) ), 1.5, 2.0 );
+}
+
+template< int Order >
+void BM_PeriodDerivative( benchmark::State& state )
+{
+    const metal::Double< "x" > sma;
+    const metal::Double< "y" > gm;
+    eval( state, derivative< Order >( period( sma, gm ), sma ), 7000.0, 398600.0 );
+}
+
+BENCHMARK_TEMPLATE( BM_FooDerivative, 0 );
+BENCHMARK_TEMPLATE( BM_FooDerivative, 1 );
+BENCHMARK_TEMPLATE( BM_FooDerivative, 2 );
+BENCHMARK_TEMPLATE( BM_FooDerivative, 3 );
+BENCHMARK_TEMPLATE( BM_FooDerivative, 4 );
+
+BENCHMARK_TEMPLATE( BM_FooDerivativeCse, 2 );
+BENCHMARK_TEMPLATE( BM_FooDerivativeCse, 4 );
+
+BENCHMARK_TEMPLATE( BM_PeriodDerivative, 0 );
+BENCHMARK_TEMPLATE( BM_PeriodDerivative, 1 );
+BENCHMARK_TEMPLATE( BM_PeriodDerivative, 2 );
+BENCHMARK_TEMPLATE( BM_PeriodDerivative, 3 );
+BENCHMARK_TEMPLATE( BM_PeriodDerivative, 4 );
+
+
+void BM_FooGradient( benchmark::State& state )
+{
+    const metal::Double< "x" > x;
+    const metal::Double< "y" > y;
+    const auto expr = foo( x, y );
+    double xv = 1.5;
+    double yv = 2.0;
+    const auto before = heap_allocations();
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( xv );
+        benchmark::DoNotOptimize( yv );
+        const metal::Bindings point{ metal::bind< "x" >( xv ), metal::bind< "y" >( yv ) };
+        benchmark::DoNotOptimize( metal::gradient( expr, point ) );
+    }
+    bench::report_allocations( state, before );
+}
+
+BENCHMARK( BM_FooGradient );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,94 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/ScalarGradient.hpp"
+#include "Allocations.hpp"
+
+#include <vector>
+#include <benchmark/benchmark.h>
+
+
+namespace
+{
+
+/** Gradient with respect to the given number of fresh parameters */
+template< int Inline >
+metal::Gradient< double, -1, Inline > make_gradient( const int size )
+{
+    typename metal::Gradient< double, -1, Inline >::Parameters parameters;
+    typename metal::Gradient< double, -1, Inline >::Value value;
+    for ( int i = 0; i < size; ++i )
+    {
+        parameters.push_back( metal::Parameter{} );
+        value.push_back( i );
+    }
+    return { std::move( parameters ), std::move( value ) };
+}
+
+} // namespace
+
+
+void BM_GradientAt( benchmark::State& state )
+{
+    const auto size = static_cast< int >( state.range( 0 ) );
+    const auto gradient = make_gradient< 0 >( size );
+    const auto& parameters = gradient.parameters();
+    const auto before = heap_allocations();
+    int i = 0;
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( gradient.at( parameters[i] ) );
+        i = i + 1 == parameters.size() ? 0 : i + 1;
+    }
+    bench::report_allocations( state, before );
+}
+
+BENCHMARK( BM_GradientAt )->RangeMultiplier( 4 )->Range( 1, 1024 );
+
+
+// Interleaved parameters, every element of the result comes from a different side than the previous one
+template< int Inline >
+void BM_GradientMerge( benchmark::State& state )
+{
+    const auto size = static_cast< int >( state.range( 0 ) );
+    auto both = make_gradient< 0 >( 2 * size );
+    typename metal::Gradient< double, -1, Inline >::Parameters left_parameters;
+    typename metal::Gradient< double, -1, Inline >::Parameters right_parameters;
+    typename metal::Gradient< double, -1, Inline >::Value left_value;
+    typename metal::Gradient< double, -1, Inline >::Value right_value;
+    for ( int i = 0; i < 2 * size; ++i )
+    {
+        ( i % 2 == 0 ? left_parameters : right_parameters ).push_back( both.parameters()[i] );
+        ( i % 2 == 0 ? left_value : right_value ).push_back( both.value()[i] );
+    }
+    const metal::Gradient< double, -1, Inline > left{ std::move( left_parameters ), std::move( left_value ) };
+    const metal::Gradient< double, -1, Inline > right{ std::move( right_parameters ), std::move( right_value ) };
+
+    const auto before = heap_allocations();
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( left + right );
+    }
+    bench::report_allocations( state, before );
+}
+
+BENCHMARK_TEMPLATE( BM_GradientMerge, 0 )->RangeMultiplier( 4 )->Range( 1, 1024 );
+BENCHMARK_TEMPLATE( BM_GradientMerge, 8 )->RangeMultiplier( 2 )->Range( 1, 4 );
+
+
+void BM_GradientMergeSame( benchmark::State& state )
+{
+    const auto size = static_cast< int >( state.range( 0 ) );
+    const auto left = make_gradient< 0 >( size );
+    const metal::Gradient< double, -1 > right{ left.parameters(), left.value() };
+
+    const auto before = heap_allocations();
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( left + right );
+    }
+    bench::report_allocations( state, before );
+}
+
+BENCHMARK( BM_GradientMergeSame )->RangeMultiplier( 4 )->Range( 1, 1024 );
+
+BENCHMARK_MAIN();
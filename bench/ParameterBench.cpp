@@ -0,0 +1,23 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Parameter.hpp"
+#include "Allocations.hpp"
+
+#include <benchmark/benchmark.h>
+
+
+// Every thread creates parameters concurrently, contending only when it reserves a new block of ids
+void BM_ParameterCreate( benchmark::State& state )
+{
+    const auto before = heap_allocations();
+    for ( auto _ : state )
+    {
+        const metal::Parameter p;
+        benchmark::DoNotOptimize( p );
+    }
+    bench::report_allocations( state, before );
+}
+
+BENCHMARK( BM_ParameterCreate )->ThreadRange( 1, 16 )->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,130 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Arena.hpp"
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+
+namespace metal
+{
+
+namespace
+{
+
+thread_local Arena* scope_arena = nullptr;
+thread_local size_t allocations = 0;
+
+void* heap_allocate( const size_t bytes )
+{
+    void* data = std::malloc( bytes );
+    if ( data == nullptr )
+    {
+        throw std::bad_alloc{};
+    }
+    ++allocations;
+    return data;
+}
+
+} // namespace
+
+
+Arena::Arena( const size_t block_size )
+    : block_size_{ block_size }
+    , current_{ 0 }
+    , offset_{ 0 }
+    , used_{ 0 }
+{
+}
+
+Arena::~Arena()
+{
+    for ( const auto& block : blocks_ )
+    {
+        std::free( block.data );
+    }
+}
+
+void* Arena::allocate( const size_t bytes, const size_t alignment )
+{
+    while ( current_ < blocks_.size() )
+    {
+        const auto& block = blocks_[current_];
+        const auto begin = ( offset_ + alignment - 1 ) / alignment * alignment;
+        if ( begin + bytes <= block.size )
+        {
+            offset_ = begin + bytes;
+            used_ += bytes;
+            return block.data + begin;
+        }
+        ++current_;
+        offset_ = 0;
+    }
+
+    // malloc aligns to max_align_t, larger alignments may need padding
+    const auto size = std::max( block_size_, bytes + alignment );
+    blocks_.push_back( Block{ static_cast< std::byte* >( heap_allocate( size ) ), size } );
+    return allocate( bytes, alignment );
+}
+
+void Arena::reset()
+{
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+size_t Arena::capacity() const
+{
+    size_t result = 0;
+    for ( const auto& block : blocks_ )
+    {
+        result += block.size;
+    }
+    return result;
+}
+
+
+ArenaScope::ArenaScope( Arena& arena )
+    : arena_{ arena }
+    , previous_{ scope_arena }
+{
+    scope_arena = &arena_;
+}
+
+ArenaScope::~ArenaScope()
+{
+    scope_arena = previous_;
+    arena_.reset();
+}
+
+Arena* current_arena()
+{
+    return scope_arena;
+}
+
+size_t storage_allocations()
+{
+    return allocations;
+}
+
+
+namespace detail
+{
+
+void* allocate( const size_t bytes, Arena* arena )
+{
+    return arena != nullptr ? arena->allocate( bytes ) : heap_allocate( bytes );
+}
+
+void deallocate( void* data, Arena* arena )
+{
+    if ( arena == nullptr )
+    {
+        std::free( data );
+    }
+}
+
+} // detail
+
+} // namespace metal
@@ -0,0 +1,96 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_ARENA_HPP
+#define METAL_ARENA_HPP
+
+#include <vector>
+#include <cstddef>
+
+
+namespace metal
+{
+
+/**
+ * Monotonic allocator handing out memory from large blocks. Memory is released in bulk by reset(),
+ * which keeps the blocks, so repeated evaluations of the same computation stop allocating once
+ * the arena has grown to its working size.
+ */
+class Arena
+{
+public:
+    explicit Arena( size_t block_size = 64 * 1024 );
+    ~Arena();
+
+    Arena( const Arena& ) = delete;
+    Arena& operator=( const Arena& ) = delete;
+
+    void* allocate( size_t bytes, size_t alignment = alignof( std::max_align_t ) );
+
+    /** Release every allocation at once, everything allocated before is invalidated */
+    void reset();
+
+    /** Bytes handed out since the last reset */
+    size_t used() const { return used_; }
+
+    /** Bytes held in blocks */
+    size_t capacity() const;
+
+private:
+    struct Block
+    {
+        std::byte* data;
+        size_t size;
+    };
+
+    std::vector< Block > blocks_;
+    size_t block_size_;
+    size_t current_;
+    size_t offset_;
+    size_t used_;
+};
+
+
+/**
+ * Makes an arena the source of storage for containers constructed on this thread during its
+ * lifetime, and resets the arena at the end. Containers constructed in the scope must not outlive
+ * it, a result is kept by assigning it to a container constructed outside, which copies it to the
+ * heap, or by copying it after the scope.
+ */
+class ArenaScope
+{
+public:
+    explicit ArenaScope( Arena& arena );
+    ~ArenaScope();
+
+    ArenaScope( const ArenaScope& ) = delete;
+    ArenaScope& operator=( const ArenaScope& ) = delete;
+
+private:
+    Arena& arena_;
+    Arena* previous_;
+};
+
+/** Arena of the innermost scope on this thread, nullptr if there is none */
+Arena* current_arena();
+
+/**
+ * Number of malloc calls made by this thread for container storage and arena blocks, allocations
+ * through the global operator new, like those of std::vector, are not included
+ */
+size_t storage_allocations();
+
+
+namespace detail
+{
+
+/** Storage from the arena, or from the heap if it is nullptr */
+void* allocate( size_t bytes, Arena* arena );
+
+/** Free storage from allocate() with the same arena, arena storage is only released with its arena */
+void deallocate( void* data, Arena* arena );
+
+} // detail
+
+} // namespace metal
+
+#endif
@@ -0,0 +1,92 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_BATCH_HPP
+#define METAL_BATCH_HPP
+
+#include "Variable.hpp"
+#include "Lanes.hpp"
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+
+namespace metal
+{
+
+namespace detail
+{
+
+template< typename T, int Width, typename Value >
+void store( T* data, const Value& value )
+{
+    if constexpr ( std::is_arithmetic_v< Value > )
+    {
+        std::fill_n( data, Width, static_cast< T >( value ) );
+    }
+    else
+    {
+        value.store( data );
+    }
+}
+
+template< typename T, int Width, typename... Columns >
+auto load( const size_t offset, const Columns&... columns )
+{
+    if constexpr ( Width == 1 )
+    {
+        return Bindings{ Binding< Columns::Name, T >{ columns.value[offset] }... };
+    }
+    else
+    {
+        using Lanes = simd::Lanes< T, Width >;
+        return Bindings{ Binding< Columns::Name, Lanes >{ Lanes::load( columns.value.data() + offset ) }... };
+    }
+}
+
+} // detail
+
+
+/** Contiguous values of the variable with the given name, one per evaluation point */
+template< detail::StringLiteral Name, typename T >
+constexpr auto column( std::span< const T > values )
+{
+    return Binding< Name, std::span< const T > >{ values };
+}
+
+template< detail::StringLiteral Name, typename T >
+constexpr auto column( const std::vector< T >& values )
+{
+    return column< Name >( std::span< const T >{ values } );
+}
+
+/**
+ * Evaluate an expression at every point of a structure-of-arrays input, processing as many
+ * points per step as fit into a vector register. Arithmetic, square roots, sines and cosines are
+ * computed on whole vectors. Unbound variables keep their own value.
+ */
+template< typename Input, typename T, typename... Columns >
+void eval_batch( const Input& input, std::span< T > result, const Columns&... columns )
+{
+    if ( ( ( columns.value.size() != result.size() ) || ... ) )
+    {
+        throw std::invalid_argument( "Column sizes do not match the result size" );
+    }
+
+    constexpr int Width = simd::NativeWidth< T >;
+    const auto size = result.size();
+    size_t i = 0;
+    for ( ; i + Width <= size; i += Width )
+    {
+        detail::store< T, Width >( result.data() + i, input.eval( detail::load< T, Width >( i, columns... ) ) );
+    }
+    for ( ; i < size; ++i )
+    {
+        result[i] = input.eval( detail::load< T, 1 >( i, columns... ) );
+    }
+}
+
+} // metal
+
+#endif
@@ -6,8 +6,9 @@
 #include "BinaryOperator.hpp"
 #include "Common.hpp"
 #include "Constant.hpp"
+#include "UnaryMath.hpp"
 #include <cmath>
-#include <fmt/core.h>
+#include <string_view>
 
 
 namespace metal
@@ -19,85 +20,118 @@ namespace detail
 struct AddOp
 {
     template< typename Left, typename Right >
-    static constexpr auto eval( Left left, Right right )
+    static constexpr auto eval( const Left& left, const Right& right )
     {
-        return left.eval() + right.eval();
+        return apply( left.eval(), right.eval() );
     }
 
-    template< typename Var, typename Left, typename Right >
-    static constexpr auto deriv( Left left, Right right )
+    template< typename Left, typename Right >
+    static constexpr auto apply( const Left& left, const Right& right )
     {
-        return diff< Var >( left ) + diff< Var >( right );
+        return left + right;
     }
 
-    template< typename Left, typename Right >
-    static constexpr std::string str( Left left, Right right )
+    template< typename Left, typename Right, typename Value, typename Seed >
+    static constexpr auto adjoint( const Left&, const Right&, const Value&, const Seed& seed )
+    {
+        return std::pair{ seed, seed };
+    }
+
+    template< typename Var, typename Left, typename Right >
+    static constexpr auto deriv( const Left& left, const Right& right )
     {
-        return fmt::format( "({0} + {1})", left.str(), right.str() );
+        return diff< Var >( left ) + diff< Var >( right );
     }
+
+    /** Text of the node, with {0} and {1} standing for the text of the operands */
+    static constexpr std::string_view Format = "({0} + {1})";
 };
 
 struct SubtractOp
 {
     template< typename Left, typename Right >
-    static constexpr auto eval( Left left, Right right )
+    static constexpr auto eval( const Left& left, const Right& right )
     {
-        return left.eval() - right.eval();
+        return apply( left.eval(), right.eval() );
     }
 
-    template< typename Var, typename Left, typename Right >
-    static constexpr auto deriv( Left left, Right right )
+    template< typename Left, typename Right >
+    static constexpr auto apply( const Left& left, const Right& right )
     {
-        return diff< Var >( left ) - diff< Var >( right );
+        return left - right;
     }
 
-    template< typename Left, typename Right >
-    static constexpr std::string str( Left left, Right right )
+    template< typename Left, typename Right, typename Value, typename Seed >
+    static constexpr auto adjoint( const Left&, const Right&, const Value&, const Seed& seed )
+    {
+        return std::pair{ seed, -seed };
+    }
+
+    template< typename Var, typename Left, typename Right >
+    static constexpr auto deriv( const Left& left, const Right& right )
     {
-        return fmt::format( "({0} - {1})", left.str(), right.str() );
+        return diff< Var >( left ) - diff< Var >( right );
     }
+
+    static constexpr std::string_view Format = "({0} - {1})";
 };
 
 struct MultiplyOp
 {
     template< typename Left, typename Right >
-    static constexpr auto eval( Left left, Right right )
+    static constexpr auto eval( const Left& left, const Right& right )
     {
-        return left.eval() * right.eval();
+        return apply( left.eval(), right.eval() );
     }
 
-    template< typename Var, typename Left, typename Right >
-    static constexpr auto deriv( Left left, Right right )
+    template< typename Left, typename Right >
+    static constexpr auto apply( const Left& left, const Right& right )
     {
-        return diff< Var >( left ) * right + diff< Var >( right ) * left;
+        return left * right;
     }
 
-    template< typename Left, typename Right >
-    static constexpr std::string str( Left left, Right right )
+    template< typename Left, typename Right, typename Value, typename Seed >
+    static constexpr auto adjoint( const Left& left, const Right& right, const Value&, const Seed& seed )
     {
-        return fmt::format( "({0} * {1})", left.str(), right.str() );
+        return std::pair{ seed * right, seed * left };
     }
+
+    template< typename Var, typename Left, typename Right >
+    static constexpr auto deriv( const Left& left, const Right& right )
+    {
+        return diff< Var >( left ) * right + diff< Var >( right ) * left;
+    }
+
+    static constexpr std::string_view Format = "({0} * {1})";
 };
 
 struct DivideOp
 {
     template< typename Left, typename Right >
-    static constexpr auto eval( Left left, Right right )
+    static constexpr auto eval( const Left& left, const Right& right )
     {
-        return left.eval() / right.eval();
+        return apply( left.eval(), right.eval() );
     }
 
-    template< typename Var, typename Left, typename Right >
-    static constexpr auto deriv( Left left, Right right )
+    template< typename Left, typename Right >
+    static constexpr auto apply( const Left& left, const Right& right )
     {
-        return ( diff< Var >( left ) * right - diff< Var >( right ) * left ) / square( right );
+        return left / right;
     }
 
-    template< typename Left, typename Right >
-    static constexpr std::string str( Left left, Right right )
+    template< typename Left, typename Right, typename Value, typename Seed >
+    static constexpr auto adjoint( const Left&, const Right& right, const Value& value, const Seed& seed )
+    {
+        return std::pair{ seed / right, -seed * value / right };
+    }
+
+    template< typename Var, typename Left, typename Right >
+    static constexpr auto deriv( const Left& left, const Right& right )
     {
-        return fmt::format( "({0} / {1})", left.str(), right.str() );
+        return ( diff< Var >( left ) * right - diff< Var >( right ) * left ) / square( right );
     }
+
+    static constexpr std::string_view Format = "({0} / {1})";
 };
 
 } // detail
@@ -107,7 +141,7 @@ template< typename Left, typename Right >
 class Add : public BinaryOperator< Left, Right, detail::AddOp >
 {
 public:
-    Add( Left left, Right right )
+    constexpr Add( const Left& left, const Right& right )
         : BinaryOperator< Left, Right, detail::AddOp >{ left, right }
     {
     }
@@ -117,7 +151,7 @@ template< typename Left, typename Right >
 class Subtract : public BinaryOperator< Left, Right, detail::SubtractOp >
 {
 public:
-    Subtract( Left left, Right right )
+    constexpr Subtract( const Left& left, const Right& right )
         : BinaryOperator< Left, Right, detail::SubtractOp >{ left, right }
     {
     }
@@ -127,7 +161,7 @@ template< typename Left, typename Right >
 class Multiply : public BinaryOperator< Left, Right, detail::MultiplyOp >
 {
 public:
-    Multiply( Left left, Right right )
+    constexpr Multiply( const Left& left, const Right& right )
         : BinaryOperator< Left, Right, detail::MultiplyOp >{ left, right }
     {
     }
@@ -137,7 +171,7 @@ template< typename Left, typename Right >
 class Divide : public BinaryOperator< Left, Right, detail::DivideOp >
 {
 public:
-    Divide( Left left, Right right )
+    constexpr Divide( const Left& left, const Right& right )
         : BinaryOperator< Left, Right, detail::DivideOp >{ left, right }
     {
     }
@@ -145,172 +179,389 @@ public:
 
 // Simplify rules
 
+namespace detail
+{
+
+/** Stateless expression which is not a number, so equal types are equal values */
+template< typename T >
+concept Symbolic = Stateless< T > && !Number< T >;
+
+} // detail
+
+// Identities
+
 template< typename Left >
-constexpr auto simplify( Add< Left, Zero > input )
+constexpr auto simplify( const Add< Left, Zero >& input )
 {
     return input.left();
 }
 
 template< typename Right >
-constexpr auto simplify( Add< Zero, Right > input )
+constexpr auto simplify( const Add< Zero, Right >& input )
 {
     return input.right();
 }
 
+constexpr auto simplify( const Add< Zero, Zero >& )
+{
+    return Zero{};
+}
+
 template< typename Left >
-constexpr auto simplify( Subtract< Left, Zero > input )
+constexpr auto simplify( const Subtract< Left, Zero >& input )
 {
     return input.left();
 }
 
 template< typename Right >
-constexpr auto simplify( Subtract< Zero, Right > input )
+constexpr auto simplify( const Subtract< Zero, Right >& input )
 {
     return -input.right();
 }
 
+constexpr auto simplify( const Subtract< Zero, Zero >& )
+{
+    return Zero{};
+}
+
 template< typename Left >
-constexpr auto simplify( Multiply< Left, Zero > )
+constexpr auto simplify( const Multiply< Left, Zero >& )
 {
     return Zero{};
 }
 
 template< typename Right >
-constexpr auto simplify( Multiply< Zero, Right > )
+constexpr auto simplify( const Multiply< Zero, Right >& )
 {
     return Zero{};
 }
 
 template< typename Left >
-constexpr auto simplify( Multiply< Left, One > input )
+constexpr auto simplify( const Multiply< Left, One >& input )
 {
     return input.left();
 }
 
 template< typename Right >
-constexpr auto simplify( Multiply< One, Right > input )
+constexpr auto simplify( const Multiply< One, Right >& input )
 {
     return input.right();
 }
 
-// Operators
+constexpr auto simplify( const Multiply< Zero, Zero >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const Multiply< Zero, One >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const Multiply< One, Zero >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const Multiply< One, One >& )
+{
+    return One{};
+}
+
+template< typename Right >
+constexpr auto simplify( const Divide< Zero, Right >& )
+{
+    return Zero{};
+}
+
+template< typename Left >
+constexpr auto simplify( const Divide< Left, One >& input )
+{
+    return input.left();
+}
+
+constexpr auto simplify( const Divide< Zero, One >& )
+{
+    return Zero{};
+}
+
+// Constant folding
+
+template< detail::Number Left, detail::Number Right >
+constexpr auto simplify( const Add< Left, Right >& input )
+{
+    return Constant{ input.left().eval() + input.right().eval() };
+}
+
+template< detail::Number Left, detail::Number Right >
+constexpr auto simplify( const Subtract< Left, Right >& input )
+{
+    return Constant{ input.left().eval() - input.right().eval() };
+}
+
+template< detail::Number Left, detail::Number Right >
+constexpr auto simplify( const Multiply< Left, Right >& input )
+{
+    return Constant{ input.left().eval() * input.right().eval() };
+}
+
+template< detail::Number Left, detail::Number Right >
+constexpr auto simplify( const Divide< Left, Right >& input )
+{
+    return Constant{ input.left().eval() / input.right().eval() };
+}
+
+// Coefficients are kept on the left and merged
+
+template< typename Left, detail::Coefficient Right >
+requires( !detail::Number< Left > )
+constexpr auto simplify( const Multiply< Left, Right >& input )
+{
+    return input.right() * input.left();
+}
+
+template< detail::Coefficient Left, detail::Number Coeff, typename Right >
+constexpr auto simplify( const Multiply< Left, Multiply< Coeff, Right > >& input )
+{
+    return Constant{ input.left().eval() * input.right().left().eval() } * input.right().right();
+}
+
+// Repeated operands
+
+template< detail::Symbolic Input >
+constexpr auto simplify( const Multiply< Input, Input >& input )
+{
+    return square( input.left() );
+}
+
+template< detail::Symbolic Input >
+constexpr auto simplify( const Multiply< SquareRoot< Input >, SquareRoot< Input > >& input )
+{
+    return input.left().input();
+}
+
+template< detail::Symbolic Input >
+constexpr auto simplify( const Subtract< Input, Input >& )
+{
+    return Zero{};
+}
+
+template< detail::Symbolic Input >
+constexpr auto simplify( const Divide< Input, Input >& )
+{
+    return One{};
+}
+
+// Negation is moved outwards, or into coefficients
+
+template< typename Left, typename Right >
+requires( !detail::Number< Left > )
+constexpr auto simplify( const Add< Left, Negate< Right > >& input )
+{
+    return input.left() - input.right().input();
+}
+
+template< typename Left, typename Right >
+requires( !detail::Number< Left > )
+constexpr auto simplify( const Subtract< Left, Negate< Right > >& input )
+{
+    return input.left() + input.right().input();
+}
+
+template< typename Input >
+constexpr auto simplify( const Subtract< Negate< Input >, Negate< Input > >& input )
+{
+    return input.right().input() - input.left().input();
+}
+
+template< typename Left, typename Right >
+requires( !detail::Number< Right > )
+constexpr auto simplify( const Multiply< Negate< Left >, Right >& input )
+{
+    return -( input.left().input() * input.right() );
+}
+
+template< typename Left, typename Right >
+requires( !detail::Number< Left > )
+constexpr auto simplify( const Multiply< Left, Negate< Right > >& input )
+{
+    return -( input.left() * input.right().input() );
+}
+
+template< typename Left, typename Right >
+constexpr auto simplify( const Multiply< Negate< Left >, Negate< Right > >& input )
+{
+    return input.left().input() * input.right().input();
+}
+
+template< typename Input >
+constexpr auto simplify( const Multiply< Negate< Input >, Negate< Input > >& input )
+{
+    return input.left().input() * input.right().input();
+}
+
+template< detail::Coefficient Left, typename Right >
+constexpr auto simplify( const Multiply< Left, Negate< Right > >& input )
+{
+    return Constant{ -input.left().eval() } * input.right().input();
+}
+
+template< typename Left, typename Right >
+requires( !detail::Number< Right > )
+constexpr auto simplify( const Divide< Negate< Left >, Right >& input )
+{
+    return -( input.left().input() / input.right() );
+}
+
+template< typename Left, typename Right >
+requires( !detail::Number< Left > )
+constexpr auto simplify( const Divide< Left, Negate< Right > >& input )
+{
+    return -( input.left() / input.right().input() );
+}
 
 template< typename Left, typename Right >
-constexpr auto operator+( Left left, Right right )
+constexpr auto simplify( const Divide< Negate< Left >, Negate< Right > >& input )
+{
+    return input.left().input() / input.right().input();
+}
+
+template< typename Input >
+constexpr auto simplify( const Divide< Negate< Input >, Negate< Input > >& input )
+{
+    return input.left().input() / input.right().input();
+}
+
+template< typename Left, detail::Coefficient Right >
+constexpr auto simplify( const Divide< Negate< Left >, Right >& input )
+{
+    return input.left().input() / Constant{ -input.right().eval() };
+}
+
+template< detail::Coefficient Left, typename Right >
+constexpr auto simplify( const Divide< Left, Negate< Right > >& input )
+{
+    return Constant{ -input.left().eval() } / input.right().input();
+}
+
+// Operators
+
+template< detail::Expression Left, detail::Expression Right >
+constexpr auto operator+( const Left& left, const Right& right )
 {
     return simplify( Add{ left, right } );
 }
 
-template< typename Left >
-constexpr auto operator+( Left left, int right )
+template< detail::Expression Left >
+constexpr auto operator+( const Left& left, int right )
 {
     return simplify( Add{ left, Constant{ right } } );
 }
 
-template< typename Left >
-constexpr auto operator+( Left left, double right )
+template< detail::Expression Left >
+constexpr auto operator+( const Left& left, double right )
 {
     return simplify( Add{ left, Constant{ right } } );
 }
 
-template< typename Right >
-constexpr auto operator+( int left, Right right )
+template< detail::Expression Right >
+constexpr auto operator+( int left, const Right& right )
 {
     return simplify( Add{ Constant{ left }, right } );
 }
 
-template< typename Right >
-constexpr auto operator+( double left, Right right )
+template< detail::Expression Right >
+constexpr auto operator+( double left, const Right& right )
 {
     return simplify( Add{ Constant{ left }, right } );
 }
 
-template< typename Left, typename Right >
-constexpr auto operator-( Left left, Right right )
+template< detail::Expression Left, detail::Expression Right >
+constexpr auto operator-( const Left& left, const Right& right )
 {
     return simplify( Subtract{ left, right } );
 }
 
-template< typename Left >
-constexpr auto operator-( Left left, int right )
+template< detail::Expression Left >
+constexpr auto operator-( const Left& left, int right )
 {
     return simplify( Subtract{ left, Constant{ right } } );
 }
 
-template< typename Left >
-constexpr auto operator-( Left left, double right )
+template< detail::Expression Left >
+constexpr auto operator-( const Left& left, double right )
 {
     return simplify( Subtract{ left, Constant{ right } } );
 }
 
-template< typename Right >
-constexpr auto operator-( int left, Right right )
+template< detail::Expression Right >
+constexpr auto operator-( int left, const Right& right )
 {
     return simplify( Subtract{ Constant{ left }, right } );
 }
 
-template< typename Right >
-constexpr auto operator-( double left, Right right )
+template< detail::Expression Right >
+constexpr auto operator-( double left, const Right& right )
 {
     return simplify( Subtract{ Constant{ left }, right } );
 }
 
-template< typename Left, typename Right >
-constexpr auto operator*( Left left, Right right )
+template< detail::Expression Left, detail::Expression Right >
+constexpr auto operator*( const Left& left, const Right& right )
 {
     return simplify( Multiply{ left, right } );
 }
 
-template< typename Left >
-constexpr auto operator*( Left left, int right )
+template< detail::Expression Left >
+constexpr auto operator*( const Left& left, int right )
 {
     return simplify( Multiply{ left, Constant{ right } } );
 }
 
-template< typename Left >
-constexpr auto operator*( Left left, double right )
+template< detail::Expression Left >
+constexpr auto operator*( const Left& left, double right )
 {
     return simplify( Multiply{ left, Constant{ right } } );
 }
 
-template< typename Right >
-constexpr auto operator*( int left, Right right )
+template< detail::Expression Right >
+constexpr auto operator*( int left, const Right& right )
 {
     return simplify( Multiply{ Constant{ left }, right } );
 }
 
-template< typename Right >
-constexpr auto operator*( double left, Right right )
+template< detail::Expression Right >
+constexpr auto operator*( double left, const Right& right )
 {
     return simplify( Multiply{ Constant{ left }, right } );
 }
 
-template< typename Left, typename Right >
-constexpr auto operator/( Left left, Right right )
+template< detail::Expression Left, detail::Expression Right >
+constexpr auto operator/( const Left& left, const Right& right )
 {
     return simplify( Divide{ left, right } );
 }
 
-template< typename Left >
-constexpr auto operator/( Left left, int right )
+template< detail::Expression Left >
+constexpr auto operator/( const Left& left, int right )
 {
     return simplify( Divide{ left, Constant{ right } } );
 }
 
-template< typename Left >
-constexpr auto operator/( Left left, double right )
+template< detail::Expression Left >
+constexpr auto operator/( const Left& left, double right )
 {
     return simplify( Divide{ left, Constant{ right } } );
 }
 
-template< typename Right >
-constexpr auto operator/( int left, Right right )
+template< detail::Expression Right >
+constexpr auto operator/( int left, const Right& right )
 {
     return simplify( Divide{ Constant{ left }, right } );
 }
 
-template< typename Right >
-constexpr auto operator/( double left, Right right )
+template< detail::Expression Right >
+constexpr auto operator/( double left, const Right& right )
 {
     return simplify( Divide{ Constant{ left }, right } );
 }
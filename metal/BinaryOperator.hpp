@@ -3,38 +3,50 @@
 #ifndef METAL_BINARY_OPERATOR_HPP
 #define METAL_BINARY_OPERATOR_HPP
 
+#include "Common.hpp"
 #include <tuple>
+#include <string>
 
 
 template< typename Left, typename Right, typename Operator >
 class BinaryOperator
 {
 public:
-    constexpr BinaryOperator( Left left, Right right )
+    using LeftType = Left;
+    using RightType = Right;
+    using OperatorType = Operator;
+
+    constexpr BinaryOperator( const Left& left, const Right& right )
         : left_{ left }
         , right_{ right }
     {
     }
 
-    constexpr auto left() const { return left_; }
-    constexpr auto right() const { return right_; }
+    constexpr const Left& left() const { return left_; }
+    constexpr const Right& right() const { return right_; }
 
     constexpr auto eval() const
     {
         return Operator::eval( left_, right_ );
     }
 
+    template< typename Env >
+    constexpr auto eval( const Env& env ) const
+    {
+        return Operator::apply( left_.eval( env ), right_.eval( env ) );
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
         return Operator::template deriv< Var >( left_, right_ );
     }
 
-    std::string str() const { return Operator::str( left_, right_ ); }
+    std::string str() const { return metal::detail::to_string( *this ); }
 
 private:
-    Left left_;
-    Right right_;
+    [[no_unique_address]] Left left_;
+    [[no_unique_address]] Right right_;
 };
 
 #endif
@@ -0,0 +1,242 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Codegen.hpp"
+#include <cmath>
+#include <cctype>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/core.h>
+
+
+namespace metal
+{
+
+namespace
+{
+
+bool is_binary( const OpCode code )
+{
+    return code == OpCode::Add || code == OpCode::Subtract || code == OpCode::Multiply || code == OpCode::Divide;
+}
+
+bool is_identifier( const std::string& name )
+{
+    const auto word = []( const char c ) { return std::isalnum( static_cast< unsigned char >( c ) ) || c == '_'; };
+    return !name.empty() && !std::isdigit( static_cast< unsigned char >( name.front() ) )
+        && std::all_of( name.begin(), name.end(), word );
+}
+
+/** Literal that reads back as exactly the same double */
+std::string literal( const double value )
+{
+    if ( std::isnan( value ) )
+    {
+        return "std::numeric_limits< double >::quiet_NaN()";
+    }
+    if ( std::isinf( value ) )
+    {
+        return value > 0 ? "std::numeric_limits< double >::infinity()"
+                         : "( -std::numeric_limits< double >::infinity() )";
+    }
+    // The shortest representation which round-trips, with a decimal point so it is not an integer
+    auto text = fmt::format( "{}", value );
+    if ( text.find_first_of( ".e" ) == std::string::npos )
+    {
+        text += ".0";
+    }
+    return std::signbit( value ) ? "( " + text + " )" : text;
+}
+
+} // namespace
+
+
+std::string generate_cpp( const Program& program, const std::string& name )
+{
+    if ( !is_identifier( name ) )
+    {
+        throw std::invalid_argument( "Invalid function name " + name );
+    }
+
+    const auto& instructions = program.instructions();
+    const auto& constants = program.constants();
+    const auto& outputs = program.outputs();
+    const auto size = program.size();
+
+    // Instructions the outputs depend on, with the number of their uses, outputs count as a use
+    std::vector< bool > live( size );
+    std::vector< int > uses( size );
+    for ( const auto output : outputs )
+    {
+        live[output] = true;
+        ++uses[output];
+    }
+    for ( auto i = size - 1; i >= 0; --i )
+    {
+        const auto& [code, left, right] = instructions[i];
+        if ( !live[i] || code == OpCode::Constant || code == OpCode::Variable )
+        {
+            continue;
+        }
+        live[left] = true;
+        ++uses[left];
+        if ( is_binary( code ) )
+        {
+            live[right] = true;
+            ++uses[right];
+        }
+    }
+
+    // Products whose only use is an addition or subtraction are computed by it with a fused multiply-add
+    std::vector< bool > contracted( size );
+    const auto contractible = [&]( const int i )
+    { return instructions[i].code == OpCode::Multiply && uses[i] == 1 && !contracted[i]; };
+    for ( int i = 0; i < size; ++i )
+    {
+        const auto& [code, left, right] = instructions[i];
+        if ( live[i] && ( code == OpCode::Add || code == OpCode::Subtract ) )
+        {
+            if ( contractible( left ) )
+            {
+                contracted[left] = true;
+            }
+            else if ( contractible( right ) )
+            {
+                contracted[right] = true;
+            }
+        }
+    }
+
+    // Constants are written inline, everything else is read from its temporary
+    const auto operand = [&]( const int i )
+    {
+        return instructions[i].code == OpCode::Constant ? literal( constants[instructions[i].left] )
+                                                        : fmt::format( "t{0}", i );
+    };
+    const auto negated = [&]( const int i )
+    {
+        return instructions[i].code == OpCode::Constant ? literal( -constants[instructions[i].left] )
+                                                        : fmt::format( "-t{0}", i );
+    };
+
+    std::string source;
+    auto out = std::back_inserter( source );
+    fmt::format_to( out, "// Generated by metal, inputs: " );
+    for ( size_t k = 0; k < program.variables().size(); ++k )
+    {
+        fmt::format_to( out, "{0}{1}", k == 0 ? "" : ", ", program.variables()[k] );
+    }
+    fmt::format_to( out, "\n#include <cmath>\n#include <limits>\n\n" );
+
+    // Sincos is a GCC and Clang builtin, other compilers get the two separate calls
+    const auto linked = [&]( const int i )
+    {
+        const auto& [code, left, right] = instructions[i];
+        return live[i] && ( code == OpCode::Sin || code == OpCode::Cos ) && right >= 0 && live[right];
+    };
+    bool sincos = false;
+    for ( int i = 0; i < size && !sincos; ++i )
+    {
+        sincos = linked( i );
+    }
+    if ( sincos )
+    {
+        fmt::format_to( out,
+            "#ifndef METAL_SINCOS\n"
+            "#if defined( __GNUC__ ) || defined( __clang__ )\n"
+            "#define METAL_SINCOS( x, s, c ) __builtin_sincos( x, s, c )\n"
+            "#else\n"
+            "#define METAL_SINCOS( x, s, c ) ( *( s ) = std::sin( x ), *( c ) = std::cos( x ) )\n"
+            "#endif\n"
+            "#endif\n\n" );
+    }
+    fmt::format_to( out, "void {0}( const double* inputs, double* outputs )\n{{\n", name );
+
+    for ( int i = 0; i < size; ++i )
+    {
+        const auto& [code, left, right] = instructions[i];
+        if ( !live[i] || contracted[i] )
+        {
+            continue;
+        }
+
+        const auto assign = [&]( const std::string& value )
+        { fmt::format_to( out, "    const double t{0} = {1};\n", i, value ); };
+        switch ( code )
+        {
+        case OpCode::Constant:
+            break;
+        case OpCode::Variable:
+            assign( fmt::format( "inputs[{0}]", left ) );
+            break;
+        case OpCode::Add:
+        case OpCode::Subtract:
+        {
+            const bool add = code == OpCode::Add;
+            const auto& product = instructions[contracted[left] ? left : right];
+            if ( contracted[left] )
+            {
+                const auto addend = add ? operand( right ) : negated( right );
+                assign( fmt::format(
+                    "std::fma( {0}, {1}, {2} )", operand( product.left ), operand( product.right ), addend ) );
+            }
+            else if ( contracted[right] )
+            {
+                const auto factor = add ? operand( product.left ) : negated( product.left );
+                assign( fmt::format( "std::fma( {0}, {1}, {2} )", factor, operand( product.right ), operand( left ) ) );
+            }
+            else
+            {
+                assign( fmt::format( "{0} {1} {2}", operand( left ), add ? '+' : '-', operand( right ) ) );
+            }
+            break;
+        }
+        case OpCode::Multiply:
+            assign( fmt::format( "{0} * {1}", operand( left ), operand( right ) ) );
+            break;
+        case OpCode::Divide:
+            assign( fmt::format( "{0} / {1}", operand( left ), operand( right ) ) );
+            break;
+        case OpCode::Negate:
+            assign( negated( left ) );
+            break;
+        case OpCode::Square:
+            assign( fmt::format( "{0} * {0}", operand( left ) ) );
+            break;
+        case OpCode::Cube:
+            assign( fmt::format( "{0} * {0} * {0}", operand( left ) ) );
+            break;
+        case OpCode::SquareRoot:
+            assign( fmt::format( "std::sqrt( {0} )", operand( left ) ) );
+            break;
+        case OpCode::Sin:
+        case OpCode::Cos:
+            // Linked sine and cosine of the same argument are both written by the first of them
+            if ( linked( i ) )
+            {
+                if ( right > i )
+                {
+                    const auto sin = code == OpCode::Sin ? i : right;
+                    const auto cos = code == OpCode::Sin ? right : i;
+                    fmt::format_to( out, "    double t{0};\n    double t{1};\n", sin, cos );
+                    fmt::format_to( out, "    METAL_SINCOS( {0}, &t{1}, &t{2} );\n", operand( left ), sin, cos );
+                }
+            }
+            else
+            {
+                assign( fmt::format( "std::{0}( {1} )", code == OpCode::Sin ? "sin" : "cos", operand( left ) ) );
+            }
+            break;
+        }
+    }
+
+    for ( size_t k = 0; k < outputs.size(); ++k )
+    {
+        fmt::format_to( out, "    outputs[{0}] = {1};\n", k, operand( outputs[k] ) );
+    }
+    fmt::format_to( out, "}}\n" );
+    return source;
+}
+
+} // namespace metal
@@ -0,0 +1,46 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_CODEGEN_HPP
+#define METAL_CODEGEN_HPP
+
+#include "Program.hpp"
+#include <tuple>
+#include <string>
+
+
+namespace metal
+{
+
+/**
+ * C++ source of a standalone function evaluating the outputs of a program, with the signature
+ *
+ *     void name( const double* inputs, double* outputs )
+ *
+ * Inputs are in the order of variables() and outputs in the order of outputs(). The body is
+ * straight-line code over the instructions the outputs depend on, every subexpression computed once
+ * into its own temporary. Sines and cosines of the same argument share a single sincos call, and
+ * products used only by an addition or subtraction are contracted into std::fma, so results may
+ * differ from eval() in the last bit.
+ *
+ * The shared call is __builtin_sincos with GCC and Clang, other compilers fall back to std::sin
+ * and std::cos. Defining METAL_SINCOS( x, s, c ) before the generated code replaces it.
+ */
+std::string generate_cpp( const Program& program, const std::string& name );
+
+/** Source of a function evaluating an expression */
+template< detail::Expression Input >
+std::string generate_cpp( const Input& input, const std::string& name )
+{
+    return generate_cpp( compile( input ), name );
+}
+
+/** Source of a function evaluating several expressions, like a value together with chosen derivatives */
+template< typename... Inputs >
+std::string generate_cpp( const std::tuple< Inputs... >& inputs, const std::string& name )
+{
+    return generate_cpp( compile( inputs ), name );
+}
+
+} // namespace metal
+
+#endif
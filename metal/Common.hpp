@@ -3,28 +3,626 @@
 #ifndef METAL_COMMON_HPP
 #define METAL_COMMON_HPP
 
+#include <array>
+#include <tuple>
+#include <string>
+#include <cstddef>
+#include <utility>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <fmt/core.h>
+
+
+template< typename Left, typename Right, typename Operator >
+class BinaryOperator;
+
+template< typename Input, typename Operator >
+class UnaryOperator;
+
 
 namespace metal
 {
 
 template< typename Var, typename Input >
-constexpr auto diff( Input input )
+constexpr auto diff( const Input& input )
 {
     return simplify( input.template deriv< Var >() );
 }
 
 template< typename Var, typename Input >
-constexpr auto diff( Input input, Var )
+constexpr auto diff( const Input& input, Var )
 {
     return diff< Var >( input );
 }
 
 template< typename Input >
-constexpr auto simplify( Input input )
+constexpr auto simplify( const Input& input )
 {
     return input;
 }
 
+
+namespace detail
+{
+
+template< typename Expr >
+concept BinaryNode = requires
+{
+    typename Expr::LeftType;
+    typename Expr::RightType;
+    typename Expr::OperatorType;
+};
+
+template< typename Expr >
+concept UnaryNode = requires
+{
+    typename Expr::InputType;
+    typename Expr::OperatorType;
+};
+
+template< typename Expr >
+concept OperatorNode = BinaryNode< Expr > || UnaryNode< Expr >;
+
+template< typename Expr >
+concept Expression = requires( const Expr& expr )
+{
+    expr.eval();
+    expr.str();
+};
+
+template< typename Expr >
+concept VariableNode = requires
+{
+    Expr::Name;
+};
+
+
+template< typename Left, typename Right, typename Operator >
+std::true_type is_operator_node( const ::BinaryOperator< Left, Right, Operator >* );
+
+template< typename Input, typename Operator >
+std::true_type is_operator_node( const ::UnaryOperator< Input, Operator >* );
+
+std::false_type is_operator_node( const void* );
+
+/**
+ * Whether a type is a node of metal expressions, for overloads that would otherwise capture any
+ * type with eval() and str(). Operators are recognized by their base, leaves specialize it.
+ */
+template< typename Expr >
+struct IsNode : decltype( is_operator_node( static_cast< const Expr* >( nullptr ) ) )
+{
+};
+
+template< typename Expr >
+concept ExpressionNode = IsNode< Expr >::value;
+
+
+/** Environment without bindings, every variable evaluates to its own value */
+struct Unbound
+{
+    template< auto Name >
+    static constexpr bool has = false;
+};
+
+
+template< typename... Ts >
+struct TypeList
+{
+    static constexpr auto Size = sizeof...( Ts );
+};
+
+template< typename T, typename List >
+struct Contains;
+
+template< typename T, typename... Ts >
+struct Contains< T, TypeList< Ts... > > : std::bool_constant< ( std::is_same_v< T, Ts > || ... ) >
+{
+};
+
+template< typename T, typename List >
+struct IndexOf;
+
+template< typename T, typename... Ts >
+struct IndexOf< T, TypeList< T, Ts... > > : std::integral_constant< size_t, 0 >
+{
+};
+
+template< typename T, typename U, typename... Ts >
+struct IndexOf< T, TypeList< U, Ts... > > : std::integral_constant< size_t, 1 + IndexOf< T, TypeList< Ts... > >::value >
+{
+};
+
+template< typename List, typename T >
+struct AppendUnique;
+
+template< typename T, typename... Ts >
+struct AppendUnique< TypeList< Ts... >, T >
+{
+    using type = std::conditional_t< Contains< T, TypeList< Ts... > >::value, TypeList< Ts... >, TypeList< Ts..., T > >;
+};
+
+/** Distinct operator node types of an expression, children before parents */
+template< typename List, typename Expr >
+struct CollectNodes
+{
+    using type = List;
+};
+
+template< typename List, BinaryNode Expr >
+struct CollectNodes< List, Expr >
+{
+    using Left = typename CollectNodes< List, typename Expr::LeftType >::type;
+    using Right = typename CollectNodes< Left, typename Expr::RightType >::type;
+    using type = typename AppendUnique< Right, Expr >::type;
+};
+
+template< typename List, UnaryNode Expr >
+struct CollectNodes< List, Expr >
+{
+    using Input = typename CollectNodes< List, typename Expr::InputType >::type;
+    using type = typename AppendUnique< Input, Expr >::type;
+};
+
+template< typename Expr >
+using Nodes = typename CollectNodes< TypeList<>, Expr >::type;
+
+/** Distinct variable types of an expression, in order of appearance */
+template< typename List, typename Expr >
+struct CollectVariables
+{
+    using type = List;
+};
+
+template< typename List, VariableNode Expr >
+struct CollectVariables< List, Expr >
+{
+    using type = typename AppendUnique< List, Expr >::type;
+};
+
+template< typename List, BinaryNode Expr >
+struct CollectVariables< List, Expr >
+{
+    using Left = typename CollectVariables< List, typename Expr::LeftType >::type;
+    using type = typename CollectVariables< Left, typename Expr::RightType >::type;
+};
+
+template< typename List, UnaryNode Expr >
+struct CollectVariables< List, Expr >
+{
+    using type = typename CollectVariables< List, typename Expr::InputType >::type;
+};
+
+template< typename Expr >
+using Variables = typename CollectVariables< TypeList<>, Expr >::type;
+
+
+/** Expression without runtime constants, so all instances of the type are identical */
+template< typename Expr >
+constexpr bool is_stateless()
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        return is_stateless< typename Expr::LeftType >() && is_stateless< typename Expr::RightType >();
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        return is_stateless< typename Expr::InputType >();
+    }
+    else
+    {
+        return VariableNode< Expr > || std::is_empty_v< Expr >;
+    }
+}
+
+template< typename Expr >
+concept Stateless = is_stateless< Expr >();
+
+
+/** Structural equality of two subtrees of the same type, leaves are compared by value */
+template< typename Expr >
+constexpr bool same( const Expr& left, const Expr& right )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        return same( left.left(), right.left() ) && same( left.right(), right.right() );
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        return same( left.input(), right.input() );
+    }
+    else if constexpr ( std::is_empty_v< Expr > )
+    {
+        return true;
+    }
+    else
+    {
+        return left.eval() == right.eval();
+    }
+}
+
+
+/** Node type computed together with the given one when both have the same input, void if there is none */
+template< typename Expr >
+struct Sibling
+{
+    using type = void;
+};
+
+
+/** Whether every placeholder of a node format is {i} for one of the given number of operands */
+constexpr bool valid_format( const std::string_view format, const size_t operands )
+{
+    for ( size_t i = 0; i < format.size(); ++i )
+    {
+        if ( format[i] == '{' )
+        {
+            if ( i + 2 >= format.size() || format[i + 1] < '0'
+                || static_cast< size_t >( format[i + 1] - '0' ) >= operands || format[i + 2] != '}' )
+            {
+                return false;
+            }
+            i += 2;
+        }
+        else if ( format[i] == '}' )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Write the format of an operator, calling the writer of the i-th operand in place of {i} */
+template< typename Operator, typename Out, typename... Operands >
+constexpr Out write_format( Out out, const Operands&... operands )
+{
+    constexpr std::string_view format = Operator::Format;
+    static_assert(
+        valid_format( format, sizeof...( Operands ) ), "Placeholders of a format must be {i} of an operand" );
+    for ( size_t i = 0; i < format.size(); ++i )
+    {
+        if ( format[i] == '{' )
+        {
+            const auto index = static_cast< size_t >( format[i + 1] - '0' );
+            size_t k = 0;
+            ( ( k++ == index ? ( out = operands( out ), 0 ) : 0 ), ... );
+            i += 2;
+        }
+        else
+        {
+            *out++ = format[i];
+        }
+    }
+    return out;
+}
+
+/** Write the text of an expression to an output iterator, streaming every node into the same buffer */
+template< typename Expr, typename Out >
+constexpr Out write( const Expr& expr, Out out )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        return write_format< typename Expr::OperatorType >(
+            out, [&]( Out o ) { return write( expr.left(), o ); }, [&]( Out o ) { return write( expr.right(), o ); } );
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        return write_format< typename Expr::OperatorType >( out, [&]( Out o ) { return write( expr.input(), o ); } );
+    }
+    else
+    {
+        return expr.format_to( out );
+    }
+}
+
+/** Write the text of an expression type without runtime constants, which needs no instance */
+template< Stateless Expr, typename Out >
+constexpr Out write( Out out )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        return write_format< typename Expr::OperatorType >(
+            out, []( Out o ) { return write< typename Expr::LeftType >( o ); },
+            []( Out o ) { return write< typename Expr::RightType >( o ); } );
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        return write_format< typename Expr::OperatorType >(
+            out, []( Out o ) { return write< typename Expr::InputType >( o ); } );
+    }
+    else
+    {
+        return Expr::format_to( out );
+    }
+}
+
+/** Text of an expression */
+template< typename Expr >
+std::string to_string( const Expr& expr )
+{
+    std::string result;
+    write( expr, std::back_inserter( result ) );
+    return result;
+}
+
+template< Stateless Expr >
+struct StaticText
+{
+    static constexpr size_t Size = []
+    {
+        std::string text;
+        write< Expr >( std::back_inserter( text ) );
+        return text.size();
+    }();
+
+    static constexpr auto value = []
+    {
+        std::array< char, Size > text{};
+        write< Expr >( text.begin() );
+        return text;
+    }();
+};
+
+
+template< typename Expr, typename Env >
+struct CacheSlot
+{
+    decltype( std::declval< const Expr& >().eval( std::declval< const Env& >() ) ) value{};
+    bool valid = false;
+};
+
+template< typename List, typename Env >
+struct CacheOf;
+
+template< typename... Ts, typename Env >
+struct CacheOf< TypeList< Ts... >, Env >
+{
+    using type = std::tuple< CacheSlot< Ts, Env >... >;
+};
+
+} // detail
+
+
+/** Expression wrapper evaluating each repeated subtree only once per eval() */
+template< typename Input >
+class CommonSubexpr
+{
+public:
+    using Nodes = detail::Nodes< Input >;
+
+    template< typename Env >
+    using Cache = typename detail::CacheOf< Nodes, Env >::type;
+
+    constexpr CommonSubexpr( const Input& input )
+        : input_{ input }
+        , shared_{}
+        , fused_{}
+    {
+        // Only subtree types which occur multiple times with identical leaves are cached
+        std::array< int, Nodes::Size > count{};
+        std::array< bool, Nodes::Size > equal{};
+        equal.fill( true );
+        Representatives first{};
+        scan( input_, first, count, equal );
+        for ( size_t i = 0; i < Nodes::Size; ++i )
+        {
+            shared_[i] = count[i] > 1 && equal[i];
+        }
+        link( first, equal, std::make_index_sequence< Nodes::Size >{} );
+    }
+
+    constexpr const Input& input() const { return input_; }
+
+    /** Number of distinct subtree types that are evaluated once and reused */
+    constexpr int shared() const
+    {
+        int result = 0;
+        for ( const auto flag : shared_ )
+        {
+            result += flag;
+        }
+        return result;
+    }
+
+    /** Number of distinct subtree types that are evaluated together with a sibling, like sine and cosine */
+    constexpr int fused() const
+    {
+        int result = 0;
+        for ( const auto flag : fused_ )
+        {
+            result += flag;
+        }
+        return result;
+    }
+
+    constexpr auto eval() const { return eval( detail::Unbound{} ); }
+
+    template< typename Env >
+    constexpr auto eval( const Env& env ) const
+    {
+        Cache< Env > cache{};
+        return eval( input_, cache, env );
+    }
+
+    template< typename Var >
+    constexpr auto deriv() const
+    {
+        return input_.template deriv< Var >();
+    }
+
+    std::string str() const { return input_.str(); }
+
+    template< typename Out >
+    constexpr Out format_to( Out out ) const
+    {
+        return detail::write( input_, out );
+    }
+
+private:
+    template< typename List >
+    struct PointersOf;
+
+    template< typename... Ts >
+    struct PointersOf< detail::TypeList< Ts... > >
+    {
+        using type = std::tuple< const Ts*... >;
+    };
+
+    using Representatives = typename PointersOf< Nodes >::type;
+
+    template< typename Expr >
+    static constexpr void scan( const Expr& expr, Representatives& first, std::array< int, Nodes::Size >& count,
+        std::array< bool, Nodes::Size >& equal )
+    {
+        if constexpr ( detail::OperatorNode< Expr > )
+        {
+            if constexpr ( detail::BinaryNode< Expr > )
+            {
+                scan( expr.left(), first, count, equal );
+                scan( expr.right(), first, count, equal );
+            }
+            else
+            {
+                scan( expr.input(), first, count, equal );
+            }
+
+            constexpr auto index = detail::IndexOf< Expr, Nodes >::value;
+            auto& representative = std::get< index >( first );
+            if ( representative == nullptr )
+            {
+                representative = &expr;
+            }
+            else
+            {
+                equal[index] = equal[index] && detail::same( *representative, expr );
+            }
+            ++count[index];
+        }
+    }
+
+    template< typename Expr >
+    using SiblingOf = typename detail::Sibling< Expr >::type;
+
+    template< typename Expr >
+    static constexpr bool HasSibling = detail::Contains< SiblingOf< Expr >, Nodes >::value;
+
+    // A node and its sibling are fused when every instance of both has the same input
+    template< size_t... Is >
+    constexpr void link( const Representatives& first, const std::array< bool, Nodes::Size >& equal,
+        std::index_sequence< Is... > )
+    {
+        ( link< Is >( first, equal ), ... );
+    }
+
+    template< size_t I >
+    constexpr void link( const Representatives& first, const std::array< bool, Nodes::Size >& equal )
+    {
+        using Expr = std::remove_cvref_t< decltype( *std::get< I >( first ) ) >;
+        if constexpr ( HasSibling< Expr > )
+        {
+            constexpr auto sibling = detail::IndexOf< SiblingOf< Expr >, Nodes >::value;
+            fused_[I] = equal[I] && equal[sibling]
+                && detail::same( std::get< I >( first )->input(), std::get< sibling >( first )->input() );
+        }
+    }
+
+    template< typename Expr, typename Env >
+    constexpr auto eval( const Expr& expr, Cache< Env >& cache, const Env& env ) const
+    {
+        if constexpr ( detail::OperatorNode< Expr > )
+        {
+            constexpr auto index = detail::IndexOf< Expr, Nodes >::value;
+            auto& slot = std::get< index >( cache );
+            if ( slot.valid )
+            {
+                return slot.value;
+            }
+
+            if constexpr ( HasSibling< Expr > )
+            {
+                if ( fused_[index] )
+                {
+                    using Operator = typename Expr::OperatorType;
+                    const auto [value, sibling] = Operator::apply_with_sibling( eval( expr.input(), cache, env ) );
+                    auto& other = std::get< detail::IndexOf< SiblingOf< Expr >, Nodes >::value >( cache );
+                    other.value = sibling;
+                    other.valid = true;
+                    slot.value = value;
+                    slot.valid = true;
+                    return slot.value;
+                }
+            }
+
+            const auto value = apply( expr, cache, env );
+            if ( shared_[index] )
+            {
+                slot.value = value;
+                slot.valid = true;
+            }
+            return value;
+        }
+        else
+        {
+            return expr.eval( env );
+        }
+    }
+
+    template< typename Expr, typename Env >
+    constexpr decltype( std::declval< const Expr& >().eval( std::declval< const Env& >() ) ) apply(
+        const Expr& expr, Cache< Env >& cache, const Env& env ) const
+    {
+        using Operator = typename Expr::OperatorType;
+        if constexpr ( detail::BinaryNode< Expr > )
+        {
+            return Operator::apply( eval( expr.left(), cache, env ), eval( expr.right(), cache, env ) );
+        }
+        else
+        {
+            return Operator::apply( eval( expr.input(), cache, env ) );
+        }
+    }
+
+    Input input_;
+    std::array< bool, Nodes::Size > shared_;
+    std::array< bool, Nodes::Size > fused_;
+};
+
+/** Text of an expression type without runtime constants, rendered at compile time */
+template< detail::Stateless Expr >
+constexpr std::string_view static_str{ detail::StaticText< Expr >::value.data(), detail::StaticText< Expr >::Size };
+
+namespace detail
+{
+
+template< typename Input >
+struct IsNode< CommonSubexpr< Input > > : std::true_type
+{
+};
+
+} // detail
+
+/** Eliminate common subexpressions from the evaluation of an expression */
+template< typename Input >
+constexpr auto cse( const Input& input )
+{
+    return CommonSubexpr< Input >{ input };
+}
+
 } // metal
 
+
+/** Formatting of expressions with fmt, writing directly to the output */
+template< metal::detail::ExpressionNode Expr >
+struct fmt::formatter< Expr >
+{
+    constexpr auto parse( fmt::format_parse_context& context ) { return context.begin(); }
+
+    template< typename Context >
+    auto format( const Expr& expr, Context& context ) const
+    {
+        return metal::detail::write( expr, context.out() );
+    }
+};
+
 #endif
@@ -3,10 +3,14 @@
 #ifndef METAL_CONSTANT_HPP
 #define METAL_CONSTANT_HPP
 
+#include "Common.hpp"
 #include <tuple>
 #include <string>
+#include <algorithm>
+#include <string_view>
 #include <fmt/core.h>
 #include <cmath>
+#include <type_traits>
 
 
 namespace metal
@@ -16,7 +20,25 @@ struct Zero
 {
     constexpr auto eval() const { return 0; }
 
+    template< typename Env >
+    constexpr auto eval( const Env& ) const
+    {
+        return eval();
+    }
+
+    template< typename Var >
+    constexpr auto deriv() const
+    {
+        return Zero{};
+    }
+
     std::string str() const { return "Zero"; }
+
+    template< typename Out >
+    static constexpr Out format_to( Out out )
+    {
+        return std::ranges::copy( std::string_view{ "Zero" }, out ).out;
+    }
 };
 
 
@@ -24,6 +46,12 @@ struct One
 {
     constexpr auto eval() const { return 1; }
 
+    template< typename Env >
+    constexpr auto eval( const Env& ) const
+    {
+        return eval();
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
@@ -31,6 +59,12 @@ struct One
     }
 
     std::string str() const { return "One"; }
+
+    template< typename Out >
+    static constexpr Out format_to( Out out )
+    {
+        return std::ranges::copy( std::string_view{ "One" }, out ).out;
+    }
 };
 
 
@@ -38,6 +72,12 @@ struct Pi
 {
     constexpr auto eval() const { return M_PI; }
 
+    template< typename Env >
+    constexpr auto eval( const Env& ) const
+    {
+        return eval();
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
@@ -45,6 +85,12 @@ struct Pi
     }
 
     std::string str() const { return "Pi"; }
+
+    template< typename Out >
+    static constexpr Out format_to( Out out )
+    {
+        return std::ranges::copy( std::string_view{ "Pi" }, out ).out;
+    }
 };
 
 
@@ -52,6 +98,12 @@ struct TwoPi
 {
     constexpr auto eval() const { return 2 * M_PI; }
 
+    template< typename Env >
+    constexpr auto eval( const Env& ) const
+    {
+        return eval();
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
@@ -59,6 +111,12 @@ struct TwoPi
     }
 
     std::string str() const { return "TwoPi"; }
+
+    template< typename Out >
+    static constexpr Out format_to( Out out )
+    {
+        return std::ranges::copy( std::string_view{ "TwoPi" }, out ).out;
+    }
 };
 
 
@@ -75,6 +133,12 @@ public:
 
     constexpr auto eval() const { return value_; }
 
+    template< typename Env >
+    constexpr auto eval( const Env& ) const
+    {
+        return eval();
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
@@ -83,10 +147,65 @@ public:
 
     std::string str() const { return fmt::format( "{0}", value_ ); }
 
+    template< typename Out >
+    Out format_to( Out out ) const
+    {
+        return fmt::format_to( out, "{0}", value_ );
+    }
+
 private:
     T value_;
 };
 
+
+namespace detail
+{
+
+template< typename T >
+struct IsNumber : std::false_type
+{
+};
+
+template<>
+struct IsNumber< Zero > : std::true_type
+{
+};
+
+template<>
+struct IsNumber< One > : std::true_type
+{
+};
+
+template<>
+struct IsNumber< Pi > : std::true_type
+{
+};
+
+template<>
+struct IsNumber< TwoPi > : std::true_type
+{
+};
+
+template< typename T >
+struct IsNumber< Constant< T > > : std::true_type
+{
+};
+
+/** Expression with a value known without evaluating any variable */
+template< typename T >
+concept Number = IsNumber< T >::value;
+
+template< Number T >
+struct IsNode< T > : std::true_type
+{
+};
+
+/** Number which is not absorbed by the Zero and One identities */
+template< typename T >
+concept Coefficient = Number< T > && !std::is_same_v< T, Zero > && !std::is_same_v< T, One >;
+
+} // detail
+
 } // metal
 
 #endif
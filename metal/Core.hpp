@@ -7,6 +7,11 @@
 #include "UnaryMath.hpp"
 #include "UnaryTrigon.hpp"
 #include "BinaryMath.hpp"
+#include "Reverse.hpp"
+#include "Forward.hpp"
+#include "Hessian.hpp"
+#include "Cost.hpp"
+#include "Batch.hpp"
 
 
 // constexpr auto orbital_period( auto sma, auto gm )
@@ -0,0 +1,325 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_COST_HPP
+#define METAL_COST_HPP
+
+#include "Reverse.hpp"
+#include "UnaryMath.hpp"
+#include "UnaryTrigon.hpp"
+#include "BinaryMath.hpp"
+#include "Variable.hpp"
+#include <array>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+
+namespace metal
+{
+
+/** Number of arithmetic operations of each kind, subtractions are counted as additions */
+struct OpCounts
+{
+    int add = 0;
+    int multiply = 0;
+    int divide = 0;
+    int negate = 0;
+    int sqrt = 0;
+    int sin = 0;
+    int cos = 0;
+
+    constexpr int total() const { return add + multiply + divide + negate + sqrt + sin + cos; }
+
+    /** Square roots and trigonometric functions, typically an order of magnitude slower than the rest */
+    constexpr int transcendental() const { return sqrt + sin + cos; }
+
+    constexpr OpCounts& operator+=( const OpCounts& other )
+    {
+        add += other.add;
+        multiply += other.multiply;
+        divide += other.divide;
+        negate += other.negate;
+        sqrt += other.sqrt;
+        sin += other.sin;
+        cos += other.cos;
+        return *this;
+    }
+
+    friend constexpr OpCounts operator+( OpCounts left, const OpCounts& right ) { return left += right; }
+
+    friend constexpr OpCounts operator-( const OpCounts& left, const OpCounts& right )
+    {
+        return { left.add - right.add, left.multiply - right.multiply, left.divide - right.divide,
+            left.negate - right.negate, left.sqrt - right.sqrt, left.sin - right.sin, left.cos - right.cos };
+    }
+
+    friend constexpr bool operator==( const OpCounts&, const OpCounts& ) = default;
+};
+
+
+/**
+ * Static cost of evaluating an expression. Operations are counted once per occurrence in the tree,
+ * as eval() executes them, and once per distinct subtree type, which is the least cse() can
+ * execute when every instance of a type has the same constants.
+ */
+struct Cost
+{
+    OpCounts ops;
+    OpCounts distinct_ops;
+    int nodes = 0;
+    int depth = 0;
+    int distinct = 0;
+
+    friend constexpr bool operator==( const Cost&, const Cost& ) = default;
+};
+
+
+namespace detail
+{
+
+/** Operations performed by a single application of an operator */
+template< typename Operator >
+struct OpCost;
+
+template<>
+struct OpCost< AddOp >
+{
+    static constexpr OpCounts value{ .add = 1 };
+};
+
+template<>
+struct OpCost< SubtractOp >
+{
+    static constexpr OpCounts value{ .add = 1 };
+};
+
+template<>
+struct OpCost< MultiplyOp >
+{
+    static constexpr OpCounts value{ .multiply = 1 };
+};
+
+template<>
+struct OpCost< DivideOp >
+{
+    static constexpr OpCounts value{ .divide = 1 };
+};
+
+template<>
+struct OpCost< NegateOp >
+{
+    static constexpr OpCounts value{ .negate = 1 };
+};
+
+template<>
+struct OpCost< SquareOp >
+{
+    static constexpr OpCounts value{ .multiply = 1 };
+};
+
+template<>
+struct OpCost< CubeOp >
+{
+    static constexpr OpCounts value{ .multiply = 2 };
+};
+
+template<>
+struct OpCost< SquareRootOp >
+{
+    static constexpr OpCounts value{ .sqrt = 1 };
+};
+
+template<>
+struct OpCost< SinOp >
+{
+    static constexpr OpCounts value{ .sin = 1 };
+};
+
+template<>
+struct OpCost< CosOp >
+{
+    static constexpr OpCounts value{ .cos = 1 };
+};
+
+template< typename Expr >
+constexpr Cost tree_cost()
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        constexpr auto left = tree_cost< typename Expr::LeftType >();
+        constexpr auto right = tree_cost< typename Expr::RightType >();
+        return { left.ops + right.ops + OpCost< typename Expr::OperatorType >::value, {},
+            1 + left.nodes + right.nodes, 1 + std::max( left.depth, right.depth ), 0 };
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        constexpr auto input = tree_cost< typename Expr::InputType >();
+        return { input.ops + OpCost< typename Expr::OperatorType >::value, {}, 1 + input.nodes, 1 + input.depth, 0 };
+    }
+    else
+    {
+        return { {}, {}, 1, 1, 0 };
+    }
+}
+
+template< typename... Ts >
+constexpr OpCounts distinct_ops( TypeList< Ts... > )
+{
+    return ( OpCounts{} + ... + OpCost< typename Ts::OperatorType >::value );
+}
+
+} // detail
+
+
+/** Operation counts, size and shape of an expression type, computed at compile time */
+template< typename Expr >
+constexpr Cost cost()
+{
+    auto result = detail::tree_cost< Expr >();
+    result.distinct_ops = detail::distinct_ops( detail::Nodes< Expr >{} );
+    result.distinct = detail::Nodes< Expr >::Size;
+    return result;
+}
+
+template< typename Expr >
+constexpr Cost cost( const Expr& )
+{
+    return cost< Expr >();
+}
+
+
+/** Operations executed by Counted scalars on the calling thread */
+inline OpCounts& executed_ops()
+{
+    thread_local OpCounts counts{};
+    return counts;
+}
+
+/** Scalar counting the arithmetic operations executed on it, for measuring an evaluation */
+template< typename T >
+class Counted
+{
+public:
+    constexpr Counted() = default;
+
+    constexpr Counted( const T& value )
+        : value_{ value }
+    {
+    }
+
+    constexpr const T& value() const { return value_; }
+
+    friend Counted operator+( const Counted& x, const Counted& y )
+    {
+        return count( &OpCounts::add, x.value_ + y.value_ );
+    }
+
+    friend Counted operator-( const Counted& x, const Counted& y )
+    {
+        return count( &OpCounts::add, x.value_ - y.value_ );
+    }
+
+    friend Counted operator*( const Counted& x, const Counted& y )
+    {
+        return count( &OpCounts::multiply, x.value_ * y.value_ );
+    }
+
+    friend Counted operator/( const Counted& x, const Counted& y )
+    {
+        return count( &OpCounts::divide, x.value_ / y.value_ );
+    }
+
+    friend Counted operator-( const Counted& x )
+    {
+        return count( &OpCounts::negate, -x.value_ );
+    }
+
+    friend Counted sqrt( const Counted& x )
+    {
+        using std::sqrt;
+        return count( &OpCounts::sqrt, sqrt( x.value_ ) );
+    }
+
+    friend Counted sin( const Counted& x )
+    {
+        using std::sin;
+        return count( &OpCounts::sin, sin( x.value_ ) );
+    }
+
+    friend Counted cos( const Counted& x )
+    {
+        using std::cos;
+        return count( &OpCounts::cos, cos( x.value_ ) );
+    }
+
+    friend bool operator==( const Counted&, const Counted& ) = default;
+
+private:
+    static Counted count( int OpCounts::*kind, const T& value )
+    {
+        ++( executed_ops().*kind );
+        return Counted{ value };
+    }
+
+    T value_{};
+};
+
+
+namespace detail
+{
+
+template< typename Evaluator, typename Input, typename Env, typename... Vars, size_t... Is >
+OpCounts count_ops( const Evaluator& evaluator, const Input& input, const Env& env, TypeList< Vars... >,
+    std::index_sequence< Is... > )
+{
+    using Value = ValueOf< Input, Env >;
+    std::array< Value, sizeof...( Vars ) > values{};
+    ( lookup< Vars >( input, env, values[Is] ), ... );
+    const Bindings bindings{ Binding< Vars::Name, Counted< Value > >{ values[Is] }... };
+
+    const auto before = executed_ops();
+    [[maybe_unused]] const auto value = evaluator.eval( bindings );
+    return executed_ops() - before;
+}
+
+template< typename Evaluator, typename Input, typename Env, typename... Vars >
+OpCounts count_ops( const Evaluator& evaluator, const Input& input, const Env& env, TypeList< Vars... > vars )
+{
+    return count_ops( evaluator, input, env, vars, std::index_sequence_for< Vars... >{} );
+}
+
+} // detail
+
+
+/**
+ * Operations executed by one evaluation of an expression, measured by evaluating it with every
+ * variable bound to a Counted scalar. Operations on constants only are not counted.
+ */
+template< typename Input, typename Env >
+OpCounts count_ops( const Input& input, const Env& env )
+{
+    return detail::count_ops( input, input, env, detail::Variables< Input >{} );
+}
+
+template< typename Input >
+OpCounts count_ops( const Input& input )
+{
+    return count_ops( input, detail::Unbound{} );
+}
+
+/** Operations executed by one evaluation with common subexpression elimination */
+template< typename Input, typename Env >
+OpCounts count_ops( const CommonSubexpr< Input >& input, const Env& env )
+{
+    return detail::count_ops( input, input.input(), env, detail::Variables< Input >{} );
+}
+
+template< typename Input >
+OpCounts count_ops( const CommonSubexpr< Input >& input )
+{
+    return count_ops( input, detail::Unbound{} );
+}
+
+} // namespace metal
+
+#endif
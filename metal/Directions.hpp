@@ -0,0 +1,106 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_DIRECTIONS_HPP
+#define METAL_DIRECTIONS_HPP
+
+#include "Lanes.hpp"
+#include <array>
+#include <cstddef>
+
+
+namespace metal
+{
+
+/**
+ * Derivatives along N directions at once, used as the derivative of a Dual to get a full
+ * gradient from one forward pass. Chain rule updates are processed in vector register blocks.
+ */
+template< typename T, int N >
+class Directions
+{
+public:
+    static_assert( N > 0 );
+
+    static constexpr int Size = N;
+
+    Directions()
+        : value_{}
+    {
+    }
+
+    explicit Directions( const std::array< T, N >& value )
+        : value_{ value }
+    {
+    }
+
+    /** Seed for the i-th direction */
+    static Directions unit( const int i )
+    {
+        Directions result;
+        result.value_[i] = T{ 1 };
+        return result;
+    }
+
+    const T* data() const { return value_.data(); }
+    T* data() { return value_.data(); }
+
+    const T& operator[]( const int i ) const { return value_[i]; }
+    T& operator[]( const int i ) { return value_[i]; }
+
+    friend bool operator==( const Directions&, const Directions& ) = default;
+
+    friend Directions operator-( const Directions& x )
+    {
+        return map( [&]( const auto& v ) { return -v; }, x );
+    }
+
+    friend Directions operator+( const Directions& x, const Directions& y )
+    {
+        return map( []( const auto& a, const auto& b ) { return a + b; }, x, y );
+    }
+
+    friend Directions operator-( const Directions& x, const Directions& y )
+    {
+        return map( []( const auto& a, const auto& b ) { return a - b; }, x, y );
+    }
+
+    friend Directions operator*( const Directions& x, const T& a )
+    {
+        return map( [&]( const auto& v ) { return v * a; }, x );
+    }
+
+    friend Directions operator*( const T& a, const Directions& x ) { return x * a; }
+
+    /** Fused chain rule update dx * a + dy * b */
+    friend Directions chain( const Directions& dx, const T& a, const Directions& dy, const T& b )
+    {
+        return map( [&]( const auto& u, const auto& v ) { return u * a + v * b; }, dx, dy );
+    }
+
+    friend Directions chain( const Directions& dx, const T& a ) { return dx * a; }
+
+private:
+    using Lanes = simd::Lanes< T, simd::NativeWidth< T > >;
+
+    template< typename Function, typename... Args >
+    static Directions map( Function function, const Args&... args )
+    {
+        Directions result;
+        int i = 0;
+        for ( ; i + Lanes::Width <= N; i += Lanes::Width )
+        {
+            function( Lanes::load( args.data() + i )... ).store( result.data() + i );
+        }
+        for ( ; i < N; ++i )
+        {
+            result[i] = function( args[i]... );
+        }
+        return result;
+    }
+
+    alignas( sizeof( typename Lanes::Vector ) ) std::array< T, N > value_;
+};
+
+} // namespace metal
+
+#endif
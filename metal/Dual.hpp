@@ -1,16 +1,57 @@
 /** Copyright Gabor Varga 2023 */
 
+#ifndef METAL_DUAL_HPP
+#define METAL_DUAL_HPP
+
+#include "SinCos.hpp"
+#include <cmath>
 #include <utility>
 #include <concepts>
+#include <type_traits>
 
 
 namespace metal
 {
 
+namespace detail
+{
+
+/**
+ * Chain rule updates of derivatives, dx * a and dx * a + dy * b. Derivative types can provide
+ * fused overloads found by argument dependent lookup.
+ */
+template< typename Deriv, typename Scale >
+auto chain( const Deriv& dx, const Scale& a )
+{
+    return dx * a;
+}
+
+template< typename DerivX, typename Scale, typename DerivY >
+auto chain( const DerivX& dx, const Scale& a, const DerivY& dy, const Scale& b )
+{
+    return dx * a + dy * b;
+}
+
+} // detail
+
+
 template< typename Value, typename Deriv >
 class Dual
 {
 public:
+    Dual()
+        : value_{}
+        , deriv_{}
+    {
+    }
+
+    /** Constant with zero derivative */
+    explicit Dual( const Value& value )
+        : value_{ value }
+        , deriv_{}
+    {
+    }
+
     Dual( const Value& value, const Deriv& deriv )
         : value_{ value }
         , deriv_{ deriv }
@@ -53,6 +94,13 @@ public:
     const Value& value() const { return value_; }
     const Deriv& deriv() const { return deriv_; }
 
+    Dual& operator+=( const Dual& other )
+    {
+        value_ = value_ + other.value_;
+        deriv_ = deriv_ + other.deriv_;
+        return *this;
+    }
+
     template< typename V1, typename D1, typename V2, typename D2 >
     friend auto operator+( const Dual< V1, D1 >& x, const Dual< V2, D2 >& y );
 
@@ -61,6 +109,13 @@ private:
     Deriv deriv_;
 };
 
+/** Dual with the derivative type deduced, chain rule updates may change it, e.g. the size of a Gradient */
+template< typename Value, typename Deriv >
+auto make_dual( const Value& value, Deriv&& deriv )
+{
+    return Dual< Value, std::remove_cvref_t< Deriv > >( value, std::forward< Deriv >( deriv ) );
+}
+
 template< typename V1, typename D1, typename V2, typename D2 >
 auto operator+( const Dual< V1, D1 >& x, const Dual< V2, D2 >& y )
 {
@@ -69,4 +124,153 @@ auto operator+( const Dual< V1, D1 >& x, const Dual< V2, D2 >& y )
     return Dual< V3, D3 >( x.value_ + y.value_, x.deriv_ + y.deriv_ );
 }
 
+template< typename V1, typename D1, typename V2, typename D2 >
+auto operator-( const Dual< V1, D1 >& x, const Dual< V2, D2 >& y )
+{
+    using V3 = decltype( std::declval< V1 >() - std::declval< V2 >() );
+    using D3 = decltype( std::declval< D1 >() - std::declval< D2 >() );
+    return Dual< V3, D3 >( x.value() - y.value(), x.deriv() - y.deriv() );
+}
+
+template< typename Value, typename D1, typename D2 >
+auto operator*( const Dual< Value, D1 >& x, const Dual< Value, D2 >& y )
+{
+    using detail::chain;
+    return make_dual< Value >( x.value() * y.value(), chain( x.deriv(), y.value(), y.deriv(), x.value() ) );
+}
+
+template< typename Value, typename D1, typename D2 >
+auto operator/( const Dual< Value, D1 >& x, const Dual< Value, D2 >& y )
+{
+    using detail::chain;
+    const Value value = x.value() / y.value();
+    const Value inverse = Value{ 1 } / y.value();
+    return make_dual< Value >( value, chain( x.deriv(), inverse, y.deriv(), Value{ -value * inverse } ) );
+}
+
+template< typename Value, typename Deriv >
+auto operator-( const Dual< Value, Deriv >& x )
+{
+    return Dual< Value, Deriv >( -x.value(), -x.deriv() );
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator+( const Dual< Value, Deriv >& x, S y )
+{
+    return Dual< Value, Deriv >( x.value() + y, x.deriv() );
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator+( S x, const Dual< Value, Deriv >& y )
+{
+    return y + x;
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator-( const Dual< Value, Deriv >& x, S y )
+{
+    return Dual< Value, Deriv >( x.value() - y, x.deriv() );
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator-( S x, const Dual< Value, Deriv >& y )
+{
+    return Dual< Value, Deriv >( x - y.value(), -y.deriv() );
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator*( const Dual< Value, Deriv >& x, S y )
+{
+    using detail::chain;
+    return make_dual< Value >( x.value() * y, chain( x.deriv(), Value( y ) ) );
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator*( S x, const Dual< Value, Deriv >& y )
+{
+    return y * x;
 }
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator/( const Dual< Value, Deriv >& x, S y )
+{
+    using detail::chain;
+    return make_dual< Value >( x.value() / y, chain( x.deriv(), Value{ Value{ 1 } / y } ) );
+}
+
+template< typename Value, typename Deriv, typename S >
+requires std::is_arithmetic_v< S >
+auto operator/( S x, const Dual< Value, Deriv >& y )
+{
+    using detail::chain;
+    const Value value = x / y.value();
+    return make_dual< Value >( value, chain( y.deriv(), Value{ -value / y.value() } ) );
+}
+
+template< typename Value, typename Deriv >
+auto square( const Dual< Value, Deriv >& x )
+{
+    using detail::chain;
+    return make_dual< Value >( x.value() * x.value(), chain( x.deriv(), Value{ x.value() + x.value() } ) );
+}
+
+template< typename Value, typename Deriv >
+auto cube( const Dual< Value, Deriv >& x )
+{
+    using detail::chain;
+    const Value square = x.value() * x.value();
+    return make_dual< Value >( square * x.value(), chain( x.deriv(), Value{ 3 * square } ) );
+}
+
+template< typename Value, typename Deriv >
+auto sqrt( const Dual< Value, Deriv >& x )
+{
+    using std::sqrt;
+    using detail::chain;
+    const Value value = sqrt( x.value() );
+    return make_dual< Value >( value, chain( x.deriv(), Value{ Value{ 1 } / ( value + value ) } ) );
+}
+
+template< typename Value, typename Deriv >
+auto sin( const Dual< Value, Deriv >& x )
+{
+    using detail::chain;
+    const auto [s, c] = detail::sin_cos( x.value() );
+    return make_dual< Value >( s, chain( x.deriv(), Value{ c } ) );
+}
+
+template< typename Value, typename Deriv >
+auto cos( const Dual< Value, Deriv >& x )
+{
+    using detail::chain;
+    const auto [s, c] = detail::sin_cos( x.value() );
+    return make_dual< Value >( c, chain( x.deriv(), Value{ -s } ) );
+}
+
+/** Sine and cosine sharing the evaluation of the value */
+template< typename Value, typename Deriv >
+auto sincos( const Dual< Value, Deriv >& x )
+{
+    using detail::chain;
+    const auto [s, c] = detail::sin_cos( x.value() );
+    return std::pair{ make_dual< Value >( s, chain( x.deriv(), Value{ c } ) ),
+        make_dual< Value >( c, chain( x.deriv(), Value{ -s } ) ) };
+}
+
+/** Independent variable seeded along the i-th of the directions of its derivative */
+template< typename Deriv, typename Value >
+auto seed( const Value& value, const int i )
+{
+    return Dual< Value, Deriv >( value, Deriv::unit( i ) );
+}
+
+} // metal
+
+#endif
@@ -0,0 +1,102 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_FORWARD_HPP
+#define METAL_FORWARD_HPP
+
+#include "Reverse.hpp"
+#include <array>
+
+
+namespace metal
+{
+
+namespace detail
+{
+
+/** Value of a node together with its derivatives with respect to the requested variables */
+template< typename Value, typename Deriv, size_t Size >
+struct Tangent
+{
+    Value value;
+    std::array< Deriv, Size > deriv;
+};
+
+template< typename Deriv, typename Expr, typename Env, typename... Vars >
+constexpr auto tangent( const Expr& expr, const Env& env )
+{
+    constexpr auto Size = sizeof...( Vars );
+    if constexpr ( BinaryNode< Expr > )
+    {
+        using Operator = typename Expr::OperatorType;
+        const auto left = tangent< Deriv, typename Expr::LeftType, Env, Vars... >( expr.left(), env );
+        const auto right = tangent< Deriv, typename Expr::RightType, Env, Vars... >( expr.right(), env );
+        const auto value = Operator::apply( left.value, right.value );
+        const auto [dleft, dright] = Operator::adjoint( left.value, right.value, value, Deriv{ 1 } );
+        Tangent< decltype( value ), Deriv, Size > result{ value, {} };
+        for ( size_t i = 0; i < Size; ++i )
+        {
+            result.deriv[i] = dleft * left.deriv[i] + dright * right.deriv[i];
+        }
+        return result;
+    }
+    else if constexpr ( FusedUnaryNode< Expr, Env > )
+    {
+        using Operator = typename Expr::OperatorType;
+        const auto input = tangent< Deriv, typename Expr::InputType, Env, Vars... >( expr.input(), env );
+        const auto [value, dinput] = Operator::apply_with_deriv( input.value );
+        Tangent< ValueOf< Expr, Env >, Deriv, Size > result{ value, {} };
+        for ( size_t i = 0; i < Size; ++i )
+        {
+            result.deriv[i] = dinput * input.deriv[i];
+        }
+        return result;
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        using Operator = typename Expr::OperatorType;
+        const auto input = tangent< Deriv, typename Expr::InputType, Env, Vars... >( expr.input(), env );
+        const auto value = Operator::apply( input.value );
+        const auto dinput = Operator::adjoint( input.value, value, Deriv{ 1 } );
+        Tangent< decltype( value ), Deriv, Size > result{ value, {} };
+        for ( size_t i = 0; i < Size; ++i )
+        {
+            result.deriv[i] = dinput * input.deriv[i];
+        }
+        return result;
+    }
+    else if constexpr ( VariableNode< Expr > )
+    {
+        return Tangent< ValueOf< Expr, Env >, Deriv, Size >{ expr.eval( env ),
+            { ( Vars::Name == Expr::Name ? Deriv{ 1 } : Deriv{ 0 } )... } };
+    }
+    else
+    {
+        return Tangent< ValueOf< Expr, Env >, Deriv, Size >{ expr.eval( env ), {} };
+    }
+}
+
+} // detail
+
+
+/**
+ * Value and partial derivatives with respect to the given variables in a single traversal, the
+ * derivative rules reuse the values computed for the expression itself.
+ */
+template< typename Input, typename Env, detail::VariableNode... Vars >
+requires( !detail::VariableNode< Env > )
+constexpr auto eval_with_gradient( const Input& input, const Env& env, const Vars&... )
+{
+    using Value = detail::ValueOf< Input, Env >;
+    const auto result = detail::tangent< Value, Input, Env, Vars... >( input, env );
+    return Partials< Value, detail::TypeList< Vars... > >{ result.value, result.deriv };
+}
+
+template< typename Input, detail::VariableNode... Vars >
+constexpr auto eval_with_gradient( const Input& input, const Vars&... vars )
+{
+    return eval_with_gradient( input, detail::Unbound{}, vars... );
+}
+
+} // metal
+
+#endif
@@ -0,0 +1,114 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_GRAPH_HPP
+#define METAL_GRAPH_HPP
+
+#include "Program.hpp"
+#include <string>
+#include <stdexcept>
+
+
+namespace metal
+{
+
+class Graph;
+
+/** Handle of a node of a runtime graph, combined with the usual operators and functions */
+class Node
+{
+public:
+    Node( Graph& graph, const int index )
+        : graph_{ &graph }
+        , index_{ index }
+    {
+    }
+
+    Graph& graph() const { return *graph_; }
+    int index() const { return index_; }
+
+    friend bool operator==( const Node&, const Node& ) = default;
+
+private:
+    Graph* graph_;
+    int index_;
+};
+
+
+/**
+ * Expression built at runtime, for models whose structure is not known at compile time. Nodes are
+ * stored contiguously in topological order, and structurally identical ones are stored only once.
+ * Nodes refer to their graph, so a graph is neither copied nor moved.
+ */
+class Graph
+{
+public:
+    Graph() = default;
+    Graph( const Graph& ) = delete;
+    Graph& operator=( const Graph& ) = delete;
+
+    Node constant( double value ) { return { *this, builder_.constant( value ) }; }
+    /** Variable with the given name, throws if it already exists with a different value */
+    Node variable( const std::string& name, double value ) { return { *this, builder_.variable( name, value ) }; }
+
+    /** Apply an operation to nodes of this graph, throws if a node belongs to another one */
+    Node apply( OpCode code, const Node& input ) { return { *this, builder_.apply( code, index( input ) ) }; }
+
+    Node apply( OpCode code, const Node& left, const Node& right )
+    {
+        return { *this, builder_.apply( code, index( left ), index( right ) ) };
+    }
+
+    /** Program evaluating the given node of this graph and its gradient */
+    Program compile( const Node& output ) const { return builder_.build( index( output ) ); }
+
+private:
+    int index( const Node& node ) const
+    {
+        if ( &node.graph() != this )
+        {
+            throw std::invalid_argument( "Nodes belong to different graphs" );
+        }
+        return node.index();
+    }
+
+    ProgramBuilder builder_;
+};
+
+
+namespace detail
+{
+
+/** Apply a binary operation in the graph of the left node, which checks that the right one belongs to it */
+inline Node apply( OpCode code, const Node& left, const Node& right )
+{
+    return left.graph().apply( code, left, right );
+}
+
+} // detail
+
+
+inline Node operator+( const Node& left, const Node& right ) { return detail::apply( OpCode::Add, left, right ); }
+inline Node operator-( const Node& left, const Node& right ) { return detail::apply( OpCode::Subtract, left, right ); }
+inline Node operator*( const Node& left, const Node& right ) { return detail::apply( OpCode::Multiply, left, right ); }
+inline Node operator/( const Node& left, const Node& right ) { return detail::apply( OpCode::Divide, left, right ); }
+
+inline Node operator+( const Node& left, double right ) { return left + left.graph().constant( right ); }
+inline Node operator-( const Node& left, double right ) { return left - left.graph().constant( right ); }
+inline Node operator*( const Node& left, double right ) { return left * left.graph().constant( right ); }
+inline Node operator/( const Node& left, double right ) { return left / left.graph().constant( right ); }
+
+inline Node operator+( double left, const Node& right ) { return right.graph().constant( left ) + right; }
+inline Node operator-( double left, const Node& right ) { return right.graph().constant( left ) - right; }
+inline Node operator*( double left, const Node& right ) { return right.graph().constant( left ) * right; }
+inline Node operator/( double left, const Node& right ) { return right.graph().constant( left ) / right; }
+
+inline Node operator-( const Node& input ) { return input.graph().apply( OpCode::Negate, input ); }
+inline Node square( const Node& input ) { return input.graph().apply( OpCode::Square, input ); }
+inline Node cube( const Node& input ) { return input.graph().apply( OpCode::Cube, input ); }
+inline Node sqrt( const Node& input ) { return input.graph().apply( OpCode::SquareRoot, input ); }
+inline Node sin( const Node& input ) { return input.graph().apply( OpCode::Sin, input ); }
+inline Node cos( const Node& input ) { return input.graph().apply( OpCode::Cos, input ); }
+
+} // namespace metal
+
+#endif
@@ -0,0 +1,245 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_HESSIAN_HPP
+#define METAL_HESSIAN_HPP
+
+#include "Reverse.hpp"
+#include "Dual.hpp"
+#include "Directions.hpp"
+#include "Tape.hpp"
+#include <span>
+#include <array>
+#include <vector>
+#include <utility>
+
+
+namespace metal
+{
+
+/**
+ * Value, gradient and Hessian of an expression. The Hessian is symmetric, only its upper triangle
+ * is stored, row by row.
+ */
+template< typename Value, typename Variables >
+class Hessian;
+
+template< typename Value, typename... Vars >
+class Hessian< Value, detail::TypeList< Vars... > >
+{
+public:
+    static constexpr size_t Size = sizeof...( Vars );
+    static constexpr size_t PackedSize = Size * ( Size + 1 ) / 2;
+
+    using Gradient = Partials< Value, detail::TypeList< Vars... > >;
+
+    constexpr Hessian( const Gradient& gradient, const std::array< Value, PackedSize >& packed )
+        : gradient_{ gradient }
+        , packed_{ packed }
+    {
+    }
+
+    constexpr const Value& value() const { return gradient_.value(); }
+    constexpr const Gradient& gradient() const { return gradient_; }
+    constexpr const std::array< Value, PackedSize >& packed() const { return packed_; }
+
+    /** Second derivative with respect to the i-th and j-th variable, in any order */
+    constexpr const Value& operator()( const size_t i, const size_t j ) const
+    {
+        return i <= j ? packed_[index( i, j )] : packed_[index( j, i )];
+    }
+
+    template< detail::StringLiteral Name1, detail::StringLiteral Name2 >
+    constexpr const Value& at() const
+    {
+        return ( *this )( detail::index_of< Name1, Vars... >(), detail::index_of< Name2, Vars... >() );
+    }
+
+    template< typename Var1, typename Var2 >
+    constexpr const Value& at( const Var1&, const Var2& ) const
+    {
+        return at< Var1::Name, Var2::Name >();
+    }
+
+    /** Full matrix with both triangles */
+    constexpr std::array< std::array< Value, Size >, Size > dense() const
+    {
+        std::array< std::array< Value, Size >, Size > result{};
+        for ( size_t i = 0; i < Size; ++i )
+        {
+            for ( size_t j = 0; j < Size; ++j )
+            {
+                result[i][j] = ( *this )( i, j );
+            }
+        }
+        return result;
+    }
+
+    /** Position of the element in row i and column j >= i of the packed upper triangle */
+    static constexpr size_t index( const size_t i, const size_t j )
+    {
+        return i * Size - i * ( i - 1 ) / 2 + j - i;
+    }
+
+private:
+    Gradient gradient_;
+    std::array< Value, PackedSize > packed_;
+};
+
+
+namespace detail
+{
+
+template< typename Input, typename Env, typename... Vars, size_t... Is >
+auto hessian( const Input& input, const Env& env, TypeList< Vars... >, std::index_sequence< Is... > )
+{
+    using Value = ValueOf< Input, Env >;
+    using Hessian = metal::Hessian< Value, TypeList< Vars... > >;
+    using Directions = metal::Directions< Value, Hessian::Size >;
+
+    // Forward over reverse, every variable is seeded along its own direction of a single Dual pass
+    std::array< Value, Hessian::Size > values{};
+    ( lookup< Vars >( input, env, values[Is] ), ... );
+    const Bindings bindings{ Binding< Vars::Name, Dual< Value, Directions > >{
+        seed< Directions >( values[Is], Is ) }... };
+    const auto result = gradient( input, bindings );
+
+    // Only the upper triangle is kept, the lower one equals it up to rounding
+    std::array< Value, Hessian::PackedSize > packed{};
+    std::array< Value, Hessian::Size > partials{};
+    for ( size_t i = 0; i < Hessian::Size; ++i )
+    {
+        const auto& partial = result.partials()[i];
+        partials[i] = partial.value();
+        for ( size_t j = i; j < Hessian::Size; ++j )
+        {
+            packed[Hessian::index( i, j )] = partial.deriv()[j];
+        }
+    }
+    return Hessian{ { result.value().value(), partials }, packed };
+}
+
+template< typename Input, typename Env, typename... Vars >
+auto hessian( const Input& input, const Env& env, TypeList< Vars... > vars )
+{
+    return hessian( input, env, vars, std::index_sequence_for< Vars... >{} );
+}
+
+} // detail
+
+
+/**
+ * Value, gradient and Hessian of an expression with one forward over reverse sweep, the
+ * derivatives of the gradient along all variables are propagated together in vector registers.
+ */
+template< typename Input, typename Env >
+auto hessian( const Input& input, const Env& env )
+{
+    return detail::hessian( input, env, detail::Variables< Input >{} );
+}
+
+template< typename Input >
+auto hessian( const Input& input )
+{
+    return hessian( input, detail::Unbound{} );
+}
+
+
+/**
+ * Value, gradient and Hessian with respect to runtime parameters, sorted by id. Only the upper
+ * triangle of the Hessian is stored, row by row.
+ */
+template< typename T >
+class ParameterHessian
+{
+public:
+    ParameterHessian( Gradient< T, -1 > gradient, const T& value, std::vector< T > packed )
+        : gradient_{ std::move( gradient ) }
+        , value_{ value }
+        , packed_{ std::move( packed ) }
+    {
+    }
+
+    const typename Gradient< T, -1 >::Parameters& parameters() const { return gradient_.parameters(); }
+    int size() const { return static_cast< int >( parameters().size() ); }
+
+    const T& value() const { return value_; }
+    const Gradient< T, -1 >& gradient() const { return gradient_; }
+    const std::vector< T >& packed() const { return packed_; }
+
+    /** Second derivative with respect to the i-th and j-th parameter, in any order */
+    const T& operator()( const int i, const int j ) const
+    {
+        return i <= j ? packed_[index( i, j )] : packed_[index( j, i )];
+    }
+
+    const T& at( const Parameter& p, const Parameter& q ) const { return ( *this )( position( p ), position( q ) ); }
+
+    /** Position of the element in row i and column j >= i of the packed upper triangle */
+    int index( const int i, const int j ) const { return i * size() - i * ( i - 1 ) / 2 + j - i; }
+
+private:
+    int position( const Parameter& p ) const
+    {
+        const auto iter = std::ranges::lower_bound( parameters(), p );
+        check< ParameterNotFoundException >( iter != parameters().end() && *iter == p, p );
+        return static_cast< int >( iter - parameters().begin() );
+    }
+
+    Gradient< T, -1 > gradient_;
+    T value_;
+    std::vector< T > packed_;
+};
+
+
+/**
+ * Value, gradient and Hessian of a function of runtime parameters, forward over reverse. The
+ * function receives one active scalar per parameter and returns an active scalar, it is written
+ * generically like functions of Dual numbers. Values on the tape are Duals with Gradient
+ * derivatives seeding each parameter, so a single backward sweep yields the Hessian rows as the
+ * derivatives of the adjoints. Like for expressions, the full rows are propagated and only their
+ * upper triangle is kept.
+ */
+template< typename Function >
+ParameterHessian< double > hessian(
+    Function function, std::span< const Parameter > parameters, std::span< const double > values )
+{
+    check< std::invalid_argument >(
+        parameters.size() == values.size(), "Number of values does not match the number of parameters" );
+
+    using Scalar = Dual< double, Gradient< double, -1 > >;
+    BasicTape< Scalar > tape;
+    std::vector< BasicActive< Scalar > > inputs;
+    inputs.reserve( parameters.size() );
+    for ( size_t i = 0; i < parameters.size(); ++i )
+    {
+        const Gradient< double, -1 > seed{ { parameters[i] }, { 1.0 } };
+        inputs.push_back( tape.variable( parameters[i], Scalar{ values[i], seed } ) );
+    }
+    const BasicActive< Scalar > output = function( std::span< const BasicActive< Scalar > >{ inputs } );
+    const auto adjoints = tape.gradient( output );
+
+    // Rows are sparse over the parameters, walked together with the sorted columns
+    const auto& sorted = adjoints.parameters();
+    const auto size = sorted.size();
+    Gradient< double, -1 >::Value partials;
+    std::vector< double > packed;
+    partials.reserve( size );
+    packed.reserve( size * ( size + 1 ) / 2 );
+    for ( int i = 0; i < size; ++i )
+    {
+        const auto& adjoint = adjoints.value()[i];
+        partials.push_back( adjoint.value() );
+        const auto& columns = adjoint.deriv().parameters();
+        auto k = static_cast< int >( std::ranges::lower_bound( columns, sorted[i] ) - columns.begin() );
+        for ( int j = i; j < size; ++j )
+        {
+            const bool found = k < columns.size() && columns[k] == sorted[j];
+            packed.push_back( found ? adjoint.deriv().value()[k++] : 0.0 );
+        }
+    }
+    return { Gradient< double, -1 >{ sorted, std::move( partials ) }, output.value().value(), std::move( packed ) };
+}
+
+} // namespace metal
+
+#endif
@@ -0,0 +1,142 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_INDEXED_GRADIENT_HPP
+#define METAL_INDEXED_GRADIENT_HPP
+
+#include "ScalarGradient.hpp"
+
+#include <span>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+
+namespace metal
+{
+
+/**
+ * Maps parameters to consecutive slots, built once per parameter set. Parameters created together on
+ * one thread have nearly consecutive ids, for them a table covers the window of their ids and a
+ * lookup is a subtraction and a load. Ids from different threads or far apart in time can leave
+ * arbitrarily large gaps, when the window is more than MaxSpread times the number of parameters the
+ * slots are found by binary search instead.
+ */
+class ParameterIndex
+{
+public:
+    static constexpr Parameter::Id MaxSpread = 4;
+
+    template< typename Parameters >
+    explicit ParameterIndex( const Parameters& parameters )
+        : parameters_( parameters.begin(), parameters.end() )
+    {
+        std::ranges::sort( parameters_ );
+        const auto [first, last] = std::ranges::unique( parameters_ );
+        parameters_.erase( first, last );
+        if ( !parameters_.empty() && parameters_.back().id() - parameters_.front().id() < MaxSpread * size() )
+        {
+            offset_ = parameters_.front().id();
+            slots_.assign( static_cast< size_t >( parameters_.back().id() - offset_ + 1 ), -1 );
+            for ( int i = 0; i < size(); ++i )
+            {
+                slots_[parameters_[i].id() - offset_] = i;
+            }
+        }
+    }
+
+    /** Sorted parameters, the i-th one stored in slot i */
+    const std::vector< Parameter >& parameters() const { return parameters_; }
+
+    int size() const { return static_cast< int >( parameters_.size() ); }
+
+    /** Whether lookups go through the table over the id window */
+    bool dense() const { return !slots_.empty(); }
+
+    /** Slot of the parameter, -1 if not indexed */
+    int find( const Parameter& p ) const
+    {
+        if ( dense() )
+        {
+            // Unsigned comparison covers ids both below and above the window
+            const auto i = static_cast< size_t >( p.id() - offset_ );
+            return i < slots_.size() ? slots_[i] : -1;
+        }
+        const auto iter = std::ranges::lower_bound( parameters_, p );
+        return iter != parameters_.end() && *iter == p ? static_cast< int >( iter - parameters_.begin() ) : -1;
+    }
+
+    /** Slot of a parameter known to be indexed */
+    int slot( const Parameter& p ) const
+    {
+        return dense() ? slots_[p.id() - offset_]
+                       : static_cast< int >( std::ranges::lower_bound( parameters_, p ) - parameters_.begin() );
+    }
+
+private:
+    std::vector< Parameter > parameters_;
+    std::vector< int > slots_;
+    Parameter::Id offset_ = 0;
+};
+
+
+/** Gradient over a shared parameter index, with constant time access by parameter */
+template< typename T_ >
+class IndexedGradient
+{
+public:
+    using T = T_;
+
+    explicit IndexedGradient( std::shared_ptr< const ParameterIndex > index )
+        : index_{ std::move( index ) }
+        , value_( index_->size() )
+    {
+    }
+
+    /** Scatter a sorted gradient into the slots, its parameters must be indexed */
+    template< int Size, int Inline >
+    IndexedGradient( std::shared_ptr< const ParameterIndex > index, const Gradient< T, Size, Inline >& gradient )
+        : IndexedGradient{ std::move( index ) }
+    {
+        const auto& parameters = gradient.parameters();
+        const auto& value = gradient.value();
+        for ( size_t i = 0; i < parameters.size(); ++i )
+        {
+            at( parameters[i] ) = value[i];
+        }
+    }
+
+    const ParameterIndex& index() const { return *index_; }
+    const std::vector< Parameter >& parameters() const { return index_->parameters(); }
+
+    const T& at( const Parameter& p ) const { return value_[checked_slot( p )]; }
+    T& at( const Parameter& p ) { return value_[checked_slot( p )]; }
+
+    /** Unchecked access, the parameter must be indexed */
+    const T& operator[]( const Parameter& p ) const { return value_[index_->slot( p )]; }
+    T& operator[]( const Parameter& p ) { return value_[index_->slot( p )]; }
+
+    /** All values in slot order, for bulk reads and writes */
+    std::span< const T > values() const { return value_; }
+    std::span< T > values() { return value_; }
+
+    /** Convert back to the sorted layout */
+    Gradient< T, -1 > gradient() const
+    {
+        return Gradient< T, -1 >{ { parameters().begin(), parameters().end() }, { value_.begin(), value_.end() } };
+    }
+
+private:
+    int checked_slot( const Parameter& p ) const
+    {
+        const auto slot = index_->find( p );
+        check< ParameterNotFoundException >( slot >= 0, p );
+        return slot;
+    }
+
+    std::shared_ptr< const ParameterIndex > index_;
+    std::vector< T > value_;
+};
+
+} // namespace metal
+
+#endif
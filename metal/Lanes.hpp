@@ -0,0 +1,302 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_LANES_HPP
+#define METAL_LANES_HPP
+
+#include "SinCos.hpp"
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+#if defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+#if defined( __has_builtin )
+#if __has_builtin( __builtin_elementwise_sqrt )
+#define METAL_ELEMENTWISE_SQRT 1
+#endif
+#endif
+
+
+namespace metal
+{
+
+namespace simd
+{
+
+#if defined( __AVX512F__ )
+constexpr int NativeBytes = 64;
+#elif defined( __AVX__ )
+constexpr int NativeBytes = 32;
+#else
+constexpr int NativeBytes = 16;
+#endif
+
+/** Number of values of type T processed together by the widest available vector unit */
+template< typename T >
+constexpr int NativeWidth = NativeBytes / sizeof( T );
+
+
+namespace detail
+{
+
+/**
+ * Square root of every element of a vector with a single instruction, with the generic builtin of
+ * Clang or the SSE and AVX instructions of the vector size. Other vectors are processed element by
+ * element.
+ */
+template< typename T, typename Vector >
+Vector sqrt_vector( const Vector& x )
+{
+    if constexpr ( std::is_floating_point_v< T > )
+    {
+#if defined( METAL_ELEMENTWISE_SQRT )
+        return __builtin_elementwise_sqrt( x );
+#else
+        constexpr bool Double = std::is_same_v< T, double >;
+        constexpr bool Float = std::is_same_v< T, float >;
+#if defined( __SSE2__ )
+        if constexpr ( Double && sizeof( Vector ) == 16 )
+        {
+            return std::bit_cast< Vector >( _mm_sqrt_pd( std::bit_cast< __m128d >( x ) ) );
+        }
+        if constexpr ( Float && sizeof( Vector ) == 16 )
+        {
+            return std::bit_cast< Vector >( _mm_sqrt_ps( std::bit_cast< __m128 >( x ) ) );
+        }
+#endif
+#if defined( __AVX__ )
+        if constexpr ( Double && sizeof( Vector ) == 32 )
+        {
+            return std::bit_cast< Vector >( _mm256_sqrt_pd( std::bit_cast< __m256d >( x ) ) );
+        }
+        if constexpr ( Float && sizeof( Vector ) == 32 )
+        {
+            return std::bit_cast< Vector >( _mm256_sqrt_ps( std::bit_cast< __m256 >( x ) ) );
+        }
+#endif
+#if defined( __AVX512F__ )
+        if constexpr ( Double && sizeof( Vector ) == 64 )
+        {
+            return std::bit_cast< Vector >( _mm512_sqrt_pd( std::bit_cast< __m512d >( x ) ) );
+        }
+        if constexpr ( Float && sizeof( Vector ) == 64 )
+        {
+            return std::bit_cast< Vector >( _mm512_sqrt_ps( std::bit_cast< __m512 >( x ) ) );
+        }
+#endif
+#endif
+    }
+
+    Vector result;
+    for ( size_t i = 0; i < sizeof( Vector ) / sizeof( T ); ++i )
+    {
+        result[i] = std::sqrt( x[i] );
+    }
+    return result;
+}
+
+/** Vector of the given number of bytes, for element types of other widths than the vector of Lanes */
+template< typename T, size_t Bytes >
+struct VectorOf
+{
+    typedef T type __attribute__( ( vector_size( Bytes ) ) );
+};
+
+/**
+ * Constants of the vector sine and cosine from fdlibm. Pi / 2 is split into parts of 33 bits, so
+ * their products with the quadrants of arguments up to the limit are exact.
+ */
+struct TrigonConstants
+{
+    static constexpr double Limit = 1e5;
+    // 1.5 * 2^52, adding it rounds to an integer in the low bits of the mantissa
+    static constexpr double Round = 6755399441055744.0;
+    static constexpr double TwoOverPi = 6.36619772367581382433e-01;
+    static constexpr double HalfPi[] = { 1.57079632673412561417e+00, 6.07710050630396597660e-11,
+        2.02226624871116645580e-21 };
+    static constexpr double Sin[] = { -1.66666666666666324348e-01, 8.33333333332248946124e-03,
+        -1.98412698298579493134e-04, 2.75573137070700676789e-06, -2.50507602534068634195e-08,
+        1.58969099521155010221e-10 };
+    static constexpr double Cos[] = { 4.16666666666666019037e-02, -1.38888888888741095749e-03,
+        2.48015872894767294178e-05, -2.75573143513906633035e-07, 2.08757232129817482790e-09,
+        -1.13596475577881948265e-11 };
+};
+
+/**
+ * Polynomial with the given coefficients of increasing degree at every element of a vector. The
+ * result is written to a reference, wide vectors are not returned in registers without AVX.
+ */
+template< typename Vector, typename T, size_t N >
+void polynomial( const Vector& z, const T ( &coefficients )[N], Vector& result )
+{
+    result = Vector{} + coefficients[N - 1];
+    for ( size_t k = N - 1; k-- > 0; )
+    {
+        result = result * z + coefficients[k];
+    }
+}
+
+/**
+ * Sine and cosine of every element of a vector, reduced to [-pi/4, pi/4] around the nearest
+ * multiple of pi / 2 and approximated by the polynomials of fdlibm, within an ulp or two of the
+ * scalar functions. Floats are computed as doubles. Vectors with arguments beyond the limit of the
+ * reduction, infinite or NaN, and vectors of other types are processed element by element.
+ */
+template< typename T, typename Vector >
+std::pair< Vector, Vector > sincos_vector( const Vector& x )
+{
+    constexpr size_t Size = sizeof( Vector ) / sizeof( T );
+    if constexpr ( std::is_same_v< T, float > )
+    {
+        using Wide = typename VectorOf< double, sizeof( double ) * Size >::type;
+        const auto [s, c] = sincos_vector< double >( __builtin_convertvector( x, Wide ) );
+        return { __builtin_convertvector( s, Vector ), __builtin_convertvector( c, Vector ) };
+    }
+    else if constexpr ( std::is_same_v< T, double > )
+    {
+        using Constants = TrigonConstants;
+        // Casts between vectors of the same size reinterpret their bits like std::bit_cast, which would
+        // return wide vectors from a function and change the ABI without AVX
+        using Bits = typename VectorOf< std::int64_t, sizeof( Vector ) >::type;
+
+        bool reducible = true;
+        for ( size_t i = 0; i < Size; ++i )
+        {
+            reducible = reducible && std::abs( x[i] ) <= Constants::Limit;
+        }
+        if ( reducible )
+        {
+            // Rounding to the nearest integer leaves the quadrant in the low bits of the shifted value
+            const Vector shifted = x * Constants::TwoOverPi + Constants::Round;
+            const Vector j = shifted - Constants::Round;
+            const Bits quadrant = ( Bits )( shifted );
+            const auto& half_pi = Constants::HalfPi;
+            const Vector r = ( ( x - j * half_pi[0] ) - j * half_pi[1] ) - j * half_pi[2];
+
+            const Vector z = r * r;
+            const Vector half = z * 0.5;
+            const Vector w = 1.0 - half;
+            Vector cos_tail;
+            Vector sin_tail;
+            polynomial( z, Constants::Cos, cos_tail );
+            polynomial( z, Constants::Sin, sin_tail );
+            const Vector cosine = w + ( ( ( 1.0 - w ) - half ) + z * z * cos_tail );
+
+            // The sine of a zero is the zero itself, keeping its sign
+            const Bits zero = z == 0.0;
+            const Bits rough = ( Bits )( r + r * z * sin_tail );
+            const Bits sine = ( rough & ~zero ) | ( ( Bits )( r ) & zero );
+
+            // Odd quadrants swap sine and cosine, the sine is negated in quadrants 2 and 3, the cosine in 1 and 2
+            const Bits swap = -( quadrant & 1 );
+            const Bits cos_bits = ( Bits )( cosine );
+            const Bits sine_bits = ( ( sine & ~swap ) | ( cos_bits & swap ) ) ^ ( ( quadrant & 2 ) << 62 );
+            const Bits cosine_bits = ( ( cos_bits & ~swap ) | ( sine & swap ) ) ^ ( ( ( quadrant + 1 ) & 2 ) << 62 );
+            return { ( Vector )( sine_bits ), ( Vector )( cosine_bits ) };
+        }
+    }
+
+    Vector s;
+    Vector c;
+    for ( size_t i = 0; i < Size; ++i )
+    {
+        const auto [sine, cosine] = metal::detail::sin_cos( x[i] );
+        s[i] = sine;
+        c[i] = cosine;
+    }
+    return { s, c };
+}
+
+} // detail
+
+
+/** Fixed number of values evaluated in lock-step, mapped to a single vector register */
+template< typename T, int Width_ >
+class Lanes
+{
+public:
+    static constexpr int Width = Width_;
+
+    typedef T Vector __attribute__( ( vector_size( sizeof( T ) * Width ) ) );
+
+    Lanes() = default;
+
+    explicit Lanes( Vector value )
+        : value_{ value }
+    {
+    }
+
+    static Lanes broadcast( T value ) { return Lanes{ Vector{} + value }; }
+
+    static Lanes load( const T* data )
+    {
+        Vector value;
+        std::memcpy( &value, data, sizeof( Vector ) );
+        return Lanes{ value };
+    }
+
+    void store( T* data ) const { std::memcpy( data, &value_, sizeof( Vector ) ); }
+
+    T operator[]( const int i ) const { return value_[i]; }
+
+    const Vector& vector() const { return value_; }
+
+    friend Lanes operator-( const Lanes& x ) { return Lanes{ -x.value_ }; }
+
+    friend Lanes operator+( const Lanes& x, const Lanes& y ) { return Lanes{ x.value_ + y.value_ }; }
+    friend Lanes operator-( const Lanes& x, const Lanes& y ) { return Lanes{ x.value_ - y.value_ }; }
+    friend Lanes operator*( const Lanes& x, const Lanes& y ) { return Lanes{ x.value_ * y.value_ }; }
+    friend Lanes operator/( const Lanes& x, const Lanes& y ) { return Lanes{ x.value_ / y.value_ }; }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator+( const Lanes& x, S y ) { return x + broadcast( y ); }
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator-( const Lanes& x, S y ) { return x - broadcast( y ); }
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator*( const Lanes& x, S y ) { return x * broadcast( y ); }
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator/( const Lanes& x, S y ) { return x / broadcast( y ); }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator+( S x, const Lanes& y ) { return broadcast( x ) + y; }
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator-( S x, const Lanes& y ) { return broadcast( x ) - y; }
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator*( S x, const Lanes& y ) { return broadcast( x ) * y; }
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend Lanes operator/( S x, const Lanes& y ) { return broadcast( x ) / y; }
+
+    friend Lanes sqrt( const Lanes& x ) { return Lanes{ detail::sqrt_vector< T >( x.value_ ) }; }
+
+    // Sine and cosine share the vector kernel, the other half of the result costs a few multiplications
+    friend Lanes sin( const Lanes& x ) { return Lanes{ detail::sincos_vector< T >( x.value_ ).first }; }
+    friend Lanes cos( const Lanes& x ) { return Lanes{ detail::sincos_vector< T >( x.value_ ).second }; }
+
+    friend std::pair< Lanes, Lanes > sincos( const Lanes& x )
+    {
+        const auto [s, c] = detail::sincos_vector< T >( x.value_ );
+        return { Lanes{ s }, Lanes{ c } };
+    }
+
+private:
+    Vector value_;
+};
+
+} // simd
+
+} // metal
+
+#endif
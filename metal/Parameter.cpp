@@ -7,10 +7,17 @@
 namespace metal
 {
 
-int Parameter::get_next_id()
+Parameter::Id Parameter::get_next_id()
 {
-    static std::atomic< int > next_id = 0;
-    return ++next_id;
+    static std::atomic< Id > reserved = 0;
+    thread_local Id next = 0;
+    thread_local Id end = 0;
+    if ( next == end )
+    {
+        next = reserved.fetch_add( BlockSize, std::memory_order_relaxed ) + 1;
+        end = next + BlockSize;
+    }
+    return next++;
 }
 
 } // namespace metal
@@ -1,27 +1,42 @@
 /** Copyright Gabor Varga 2023 */
 
+#ifndef METAL_PARAMETER_HPP
+#define METAL_PARAMETER_HPP
+
 #include <compare>
+#include <cstdint>
 
 
 namespace metal
 {
 
+/**
+ * Independent variable identified by a unique id. Each thread takes ids from blocks it reserves
+ * from a global counter, so ids increase in creation order within a thread and are unique overall.
+ */
 class Parameter
 {
 public:
+    using Id = std::int64_t;
+
+    /** Number of ids a thread reserves at once */
+    static constexpr Id BlockSize = 1024;
+
     Parameter() noexcept
         : id_{ get_next_id() }
     {
     }
 
-    int id() const noexcept { return id_; }
+    Id id() const noexcept { return id_; }
 
     friend auto operator<=>( const Parameter&, const Parameter& ) = default;
 
 private:
-    static int get_next_id();
+    static Id get_next_id();
 
-    int id_;
+    Id id_;
 };
 
 } // namespace metal
+
+#endif
@@ -0,0 +1,211 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Pattern.hpp"
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <shared_mutex>
+#include <unordered_map>
+
+
+namespace metal
+{
+
+namespace detail
+{
+
+/** Positions of the parameters of two patterns in their union, the union itself is interned on demand */
+struct UnionPositions
+{
+    std::weak_ptr< const PatternNode > other;
+    std::weak_ptr< const PatternNode > pattern;
+    std::vector< int > left;
+    std::vector< int > right;
+};
+
+struct PatternNode
+{
+    std::vector< Parameter > parameters = {};
+
+    // Serial numbers are never reused, unlike addresses, so they identify the other side of a union
+    std::uint64_t serial = 0;
+
+    // Unions with other patterns, filled on first use. Entries only refer to other patterns weakly,
+    // so caches do not keep patterns alive, and entries of released patterns are swept on insertion.
+    mutable std::shared_mutex mutex = {};
+    mutable std::unordered_map< std::uint64_t, std::unique_ptr< UnionPositions > > unions = {};
+    mutable size_t sweep_size = 8;
+};
+
+namespace
+{
+
+struct ParametersHash
+{
+    size_t operator()( const std::vector< Parameter >& parameters ) const
+    {
+        size_t hash = parameters.size();
+        for ( const auto& p : parameters )
+        {
+            hash ^= std::hash< Parameter::Id >{}( p.id() ) + 0x9e3779b97f4a7c15 + ( hash << 6 ) + ( hash >> 2 );
+        }
+        return hash;
+    }
+};
+
+/** Weak table of the live patterns, a pattern removes itself when its last handle is released */
+class PatternTable
+{
+public:
+    std::shared_ptr< const PatternNode > intern( std::vector< Parameter > parameters )
+    {
+        const std::lock_guard lock{ mutex_ };
+        auto& entry = nodes_[parameters];
+        if ( auto node = entry.lock() )
+        {
+            return node;
+        }
+        auto* node = new PatternNode{ std::move( parameters ), next_serial_++ };
+        std::shared_ptr< const PatternNode > result{ node, [this]( const PatternNode* node ) { release( node ); } };
+        entry = result;
+        return result;
+    }
+
+    size_t size()
+    {
+        const std::lock_guard lock{ mutex_ };
+        return nodes_.size();
+    }
+
+private:
+    void release( const PatternNode* node )
+    {
+        {
+            const std::lock_guard lock{ mutex_ };
+            // The entry may already refer to a pattern interned again after the last handle was dropped
+            const auto iter = nodes_.find( node->parameters );
+            if ( iter != nodes_.end() && iter->second.expired() )
+            {
+                nodes_.erase( iter );
+            }
+        }
+        delete node;
+    }
+
+    std::mutex mutex_;
+    std::uint64_t next_serial_ = 0;
+    std::unordered_map< std::vector< Parameter >, std::weak_ptr< const PatternNode >, ParametersHash > nodes_;
+};
+
+PatternTable& table()
+{
+    // Never destroyed, patterns held by static objects are released after the end of main
+    static auto* instance = new PatternTable;
+    return *instance;
+}
+
+std::vector< Parameter > union_parameters( const PatternNode& left, const PatternNode& right )
+{
+    std::vector< Parameter > result;
+    result.reserve( left.parameters.size() + right.parameters.size() );
+    std::ranges::set_union( left.parameters, right.parameters, std::back_inserter( result ) );
+    return result;
+}
+
+std::vector< int > positions( const std::vector< Parameter >& parameters, const std::vector< Parameter >& subset )
+{
+    std::vector< int > result;
+    result.reserve( subset.size() );
+    for ( size_t i = 0, j = 0; i < parameters.size() && j < subset.size(); ++i )
+    {
+        if ( subset[j] == parameters[i] )
+        {
+            result.push_back( static_cast< int >( i ) );
+            ++j;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+} // detail
+
+
+Pattern::Pattern()
+{
+    static const auto empty = detail::table().intern( {} );
+    node_ = empty;
+}
+
+Pattern Pattern::intern( std::vector< Parameter > parameters )
+{
+    std::ranges::sort( parameters );
+    const auto [first, last] = std::ranges::unique( parameters );
+    parameters.erase( first, last );
+    return Pattern{ detail::table().intern( std::move( parameters ) ) };
+}
+
+size_t Pattern::interned()
+{
+    return detail::table().size();
+}
+
+const std::vector< Parameter >& Pattern::parameters() const
+{
+    return node_->parameters;
+}
+
+int Pattern::find( const Parameter& p ) const
+{
+    const auto& parameters = node_->parameters;
+    const auto iter = std::ranges::lower_bound( parameters, p );
+    if ( iter == parameters.end() || *iter != p )
+    {
+        return -1;
+    }
+    return static_cast< int >( std::distance( parameters.begin(), iter ) );
+}
+
+PatternUnion Pattern::unite( const Pattern& other ) const
+{
+    // Cached positions are only written once, under the exclusive lock, so readers share the lock
+    {
+        const std::shared_lock lock{ node_->mutex };
+        const auto iter = node_->unions.find( other.node_->serial );
+        if ( iter != node_->unions.end() )
+        {
+            if ( auto pattern = iter->second->pattern.lock() )
+            {
+                return PatternUnion{ Pattern{ std::move( pattern ) }, iter->second->left, iter->second->right };
+            }
+        }
+    }
+
+    const std::unique_lock lock{ node_->mutex };
+    auto& entry = node_->unions[other.node_->serial];
+    auto pattern = entry ? entry->pattern.lock() : nullptr;
+    if ( !pattern )
+    {
+        auto parameters = detail::union_parameters( *node_, *other.node_ );
+        if ( !entry )
+        {
+            entry = std::make_unique< detail::UnionPositions >( detail::UnionPositions{ other.node_, {},
+                detail::positions( parameters, node_->parameters ),
+                detail::positions( parameters, other.node_->parameters ) } );
+        }
+        pattern = detail::table().intern( std::move( parameters ) );
+        entry->pattern = pattern;
+    }
+    const PatternUnion result{ Pattern{ std::move( pattern ) }, entry->left, entry->right };
+
+    if ( node_->unions.size() >= node_->sweep_size )
+    {
+        std::erase_if( node_->unions, []( const auto& item ) { return item.second->other.expired(); } );
+        node_->sweep_size = std::max< size_t >( 8, 2 * node_->unions.size() );
+    }
+    return result;
+}
+
+} // namespace metal
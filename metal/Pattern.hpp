@@ -0,0 +1,202 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_PATTERN_HPP
+#define METAL_PATTERN_HPP
+
+#include "ScalarGradient.hpp"
+
+#include <span>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+
+
+namespace metal
+{
+
+namespace detail
+{
+
+struct PatternNode;
+
+} // detail
+
+
+struct PatternUnion;
+
+/**
+ * Handle of an interned, immutable and sorted set of parameters. Equal sets are stored only once,
+ * so handles are compared as pointers, and are released with the last handle referring to them.
+ */
+class Pattern
+{
+public:
+    /** The empty pattern */
+    Pattern();
+
+    /** Pattern of the given parameters, in any order and possibly with duplicates */
+    static Pattern intern( std::vector< Parameter > parameters );
+
+    const std::vector< Parameter >& parameters() const;
+    int size() const { return static_cast< int >( parameters().size() ); }
+
+    /** Position of the parameter, -1 if it is not part of the pattern */
+    int find( const Parameter& p ) const;
+
+    /** Union with another pattern, the positions are computed once per pair of live patterns */
+    PatternUnion unite( const Pattern& other ) const;
+
+    /** Number of distinct patterns alive */
+    static size_t interned();
+
+    friend bool operator==( const Pattern&, const Pattern& ) = default;
+
+private:
+    explicit Pattern( std::shared_ptr< const detail::PatternNode > node )
+        : node_{ std::move( node ) }
+    {
+    }
+
+    std::shared_ptr< const detail::PatternNode > node_;
+};
+
+/**
+ * Union of two patterns and the positions the parameters of each one take in it. The positions are
+ * cached by the left pattern and stay valid while both patterns are alive.
+ */
+struct PatternUnion
+{
+    Pattern pattern;
+    std::span< const int > left;
+    std::span< const int > right;
+};
+
+
+/**
+ * Gradient holding only its values and the handle of its interned parameter pattern. Operations
+ * between gradients of the same pattern are plain vector arithmetic, others scatter into the
+ * cached union of the two patterns.
+ */
+template< typename T_ >
+class PatternGradient
+{
+public:
+    using T = T_;
+
+    PatternGradient() = default;
+
+    explicit PatternGradient( const Pattern& pattern )
+        : pattern_{ pattern }
+        , value_( pattern.size() )
+    {
+    }
+
+    /** Values in the order of the parameters of the pattern */
+    PatternGradient( const Pattern& pattern, std::vector< T > value )
+        : pattern_{ pattern }
+        , value_{ std::move( value ) }
+    {
+        check< std::invalid_argument >( static_cast< int >( value_.size() ) == pattern_.size(),
+            "Number of values does not match the pattern size" );
+    }
+
+    template< int Size, int Inline >
+    explicit PatternGradient( const Gradient< T, Size, Inline >& gradient )
+        : PatternGradient{ Pattern::intern( { gradient.parameters().begin(), gradient.parameters().end() } ),
+            { gradient.value().begin(), gradient.value().end() } }
+    {
+    }
+
+    const Pattern& pattern() const { return pattern_; }
+    const std::vector< Parameter >& parameters() const { return pattern_.parameters(); }
+    const std::vector< T >& value() const { return value_; }
+
+    const T& at( const Parameter& p ) const { return value_[checked_find( p )]; }
+    T& at( const Parameter& p ) { return value_[checked_find( p )]; }
+
+    friend PatternGradient operator-( const PatternGradient& x )
+    {
+        return x.transform( []( const T& u ) { return -u; } );
+    }
+
+    friend PatternGradient operator*( const PatternGradient& x, const T& a )
+    {
+        return x.transform( [&]( const T& u ) { return u * a; } );
+    }
+
+    friend PatternGradient operator*( const T& a, const PatternGradient& x ) { return x * a; }
+
+    friend PatternGradient operator+( const PatternGradient& x, const PatternGradient& y )
+    {
+        return combine( x, y, []( const T& u, const T& v ) { return u + v; } );
+    }
+
+    friend PatternGradient operator-( const PatternGradient& x, const PatternGradient& y )
+    {
+        return combine( x, y, []( const T& u, const T& v ) { return u - v; } );
+    }
+
+    /** a * x + y */
+    friend PatternGradient axpy( const T& a, const PatternGradient& x, const PatternGradient& y )
+    {
+        return combine( x, y, [&]( const T& u, const T& v ) { return a * u + v; } );
+    }
+
+    /** Chain rule update dx * a + dy * b of a Dual with PatternGradient derivatives */
+    friend PatternGradient chain( const PatternGradient& dx, const T& a, const PatternGradient& dy, const T& b )
+    {
+        return combine( dx, dy, [&]( const T& u, const T& v ) { return u * a + v * b; } );
+    }
+
+private:
+    int checked_find( const Parameter& p ) const
+    {
+        const auto i = pattern_.find( p );
+        check< ParameterNotFoundException >( i >= 0, p );
+        return i;
+    }
+
+    template< typename Function >
+    PatternGradient transform( Function function ) const
+    {
+        PatternGradient result{ pattern_ };
+        for ( size_t i = 0; i < value_.size(); ++i )
+        {
+            result.value_[i] = function( value_[i] );
+        }
+        return result;
+    }
+
+    /** Apply function( u, v ) per parameter, a parameter missing from one side contributes zero */
+    template< typename Function >
+    static PatternGradient combine( const PatternGradient& x, const PatternGradient& y, Function function )
+    {
+        if ( x.pattern_ == y.pattern_ )
+        {
+            PatternGradient result{ x.pattern_ };
+            for ( size_t i = 0; i < x.value_.size(); ++i )
+            {
+                result.value_[i] = function( x.value_[i], y.value_[i] );
+            }
+            return result;
+        }
+
+        // Positions are increasing, so each side is consumed in order while walking the union
+        const auto [pattern, left, right] = x.pattern_.unite( y.pattern_ );
+        PatternGradient result{ pattern };
+        for ( size_t k = 0, i = 0, j = 0; k < result.value_.size(); ++k )
+        {
+            const bool in_left = i < left.size() && left[i] == static_cast< int >( k );
+            const bool in_right = j < right.size() && right[j] == static_cast< int >( k );
+            result.value_[k] = function( in_left ? x.value_[i++] : T{}, in_right ? y.value_[j++] : T{} );
+        }
+        return result;
+    }
+
+    Pattern pattern_;
+    std::vector< T > value_;
+};
+
+} // namespace metal
+
+#endif
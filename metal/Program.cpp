@@ -0,0 +1,387 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Program.hpp"
+#include <bit>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <stdexcept>
+
+
+namespace metal
+{
+
+Program::Program( std::vector< Instruction > instructions, std::vector< double > constants,
+    std::vector< std::string > variables, std::vector< double > values, int output )
+    : Program{ std::move( instructions ), std::move( constants ), std::move( variables ), std::move( values ),
+        std::vector< int >{ output } }
+{
+}
+
+Program::Program( std::vector< Instruction > instructions, std::vector< double > constants,
+    std::vector< std::string > variables, std::vector< double > values, std::vector< int > outputs )
+    : instructions_{ std::move( instructions ) }
+    , constants_{ std::move( constants ) }
+    , variables_{ std::move( variables ) }
+    , values_{ std::move( values ) }
+    , outputs_{ std::move( outputs ) }
+{
+    validate();
+    link_siblings();
+}
+
+void Program::validate() const
+{
+    if ( values_.size() != variables_.size() )
+    {
+        throw std::invalid_argument( "Program variables and values differ in size" );
+    }
+    const auto constants = static_cast< int >( constants_.size() );
+    const auto variables = static_cast< int >( variables_.size() );
+    // Operands refer to earlier registers, the right operand of sines and cosines is their sibling
+    const auto earlier = []( const int operand, const int i ) { return operand >= 0 && operand < i; };
+    for ( int i = 0; i < size(); ++i )
+    {
+        const auto& instruction = instructions_[i];
+        bool valid = false;
+        switch ( instruction.code )
+        {
+        case OpCode::Constant:
+            valid = instruction.left >= 0 && instruction.left < constants;
+            break;
+        case OpCode::Variable:
+            valid = instruction.left >= 0 && instruction.left < variables;
+            break;
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+            valid = earlier( instruction.left, i ) && earlier( instruction.right, i );
+            break;
+        case OpCode::Negate:
+        case OpCode::Square:
+        case OpCode::Cube:
+        case OpCode::SquareRoot:
+        case OpCode::Sin:
+        case OpCode::Cos:
+            valid = earlier( instruction.left, i );
+            break;
+        }
+        if ( !valid )
+        {
+            throw std::invalid_argument( "Invalid instruction operands" );
+        }
+    }
+    if ( outputs_.empty() )
+    {
+        throw std::invalid_argument( "Program without output" );
+    }
+    for ( const auto output : outputs_ )
+    {
+        if ( output < 0 || output >= size() )
+        {
+            throw std::invalid_argument( "Invalid program output" );
+        }
+    }
+}
+
+void Program::link_siblings()
+{
+    // Sine and cosine of the same register, at most one of each since instructions are unique
+    std::unordered_map< int, int > sines;
+    std::unordered_map< int, int > cosines;
+    for ( int i = 0; i < size(); ++i )
+    {
+        auto& instruction = instructions_[i];
+        if ( instruction.code == OpCode::Sin || instruction.code == OpCode::Cos )
+        {
+            instruction.right = -1;
+            auto& own = instruction.code == OpCode::Sin ? sines : cosines;
+            auto& other = instruction.code == OpCode::Sin ? cosines : sines;
+            own.try_emplace( instruction.left, i );
+            if ( const auto iter = other.find( instruction.left ); iter != other.end() )
+            {
+                instruction.right = iter->second;
+                instructions_[iter->second].right = i;
+            }
+        }
+    }
+}
+
+double Program::eval() const
+{
+    return eval( values_ );
+}
+
+double Program::eval( std::span< const double > inputs ) const
+{
+    std::vector< double > registers( instructions_.size() );
+    return eval( inputs, registers );
+}
+
+double Program::eval( std::span< const double > inputs, std::span< double > registers ) const
+{
+    if ( inputs.size() != variables_.size() )
+    {
+        throw std::invalid_argument( "Number of inputs does not match the number of variables" );
+    }
+    if ( registers.size() < instructions_.size() )
+    {
+        throw std::invalid_argument( "Not enough registers" );
+    }
+
+    double* r = registers.data();
+    const auto size = instructions_.size();
+    for ( size_t i = 0; i < size; ++i )
+    {
+        const auto& [code, left, right] = instructions_[i];
+        switch ( code )
+        {
+        case OpCode::Constant:
+            r[i] = constants_[left];
+            break;
+        case OpCode::Variable:
+            r[i] = inputs[left];
+            break;
+        case OpCode::Add:
+            r[i] = r[left] + r[right];
+            break;
+        case OpCode::Subtract:
+            r[i] = r[left] - r[right];
+            break;
+        case OpCode::Multiply:
+            r[i] = r[left] * r[right];
+            break;
+        case OpCode::Divide:
+            r[i] = r[left] / r[right];
+            break;
+        case OpCode::Negate:
+            r[i] = -r[left];
+            break;
+        case OpCode::Square:
+            r[i] = r[left] * r[left];
+            break;
+        case OpCode::Cube:
+            r[i] = r[left] * r[left] * r[left];
+            break;
+        case OpCode::SquareRoot:
+            r[i] = std::sqrt( r[left] );
+            break;
+        case OpCode::Sin:
+            if ( right < 0 )
+            {
+                r[i] = std::sin( r[left] );
+            }
+            else if ( static_cast< size_t >( right ) > i )
+            {
+                std::tie( r[i], r[right] ) = sincos( r[left] );
+            }
+            break;
+        case OpCode::Cos:
+            if ( right < 0 )
+            {
+                r[i] = std::cos( r[left] );
+            }
+            else if ( static_cast< size_t >( right ) > i )
+            {
+                std::tie( r[right], r[i] ) = sincos( r[left] );
+            }
+            break;
+        }
+    }
+    return r[outputs_.front()];
+}
+
+double Program::gradient( std::span< const double > inputs, std::span< double > gradient ) const
+{
+    std::vector< double > workspace( 2 * instructions_.size() );
+    return this->gradient( inputs, gradient, workspace );
+}
+
+double Program::gradient(
+    std::span< const double > inputs, std::span< double > gradient, std::span< double > workspace ) const
+{
+    if ( gradient.size() != variables_.size() )
+    {
+        throw std::invalid_argument( "Gradient size does not match the number of variables" );
+    }
+    if ( workspace.size() < 2 * instructions_.size() )
+    {
+        throw std::invalid_argument( "Not enough workspace" );
+    }
+
+    const auto size = instructions_.size();
+    const double value = eval( inputs, workspace.first( size ) );
+    std::fill( gradient.begin(), gradient.end(), 0.0 );
+    backward( workspace.data(), workspace.data() + size, outputs_.front(), gradient );
+    return value;
+}
+
+void Program::backward( const double* r, double* a, const int output, std::span< double > gradient ) const
+{
+    std::fill_n( a, output + 1, 0.0 );
+    a[output] = 1.0;
+
+    // Instructions after the output do not contribute
+    for ( auto i = output; i >= 0; --i )
+    {
+        const auto& [code, left, right] = instructions_[i];
+        const double seed = a[i];
+        switch ( code )
+        {
+        case OpCode::Constant:
+            break;
+        case OpCode::Variable:
+            gradient[left] += seed;
+            break;
+        case OpCode::Add:
+            a[left] += seed;
+            a[right] += seed;
+            break;
+        case OpCode::Subtract:
+            a[left] += seed;
+            a[right] -= seed;
+            break;
+        case OpCode::Multiply:
+            a[left] += seed * r[right];
+            a[right] += seed * r[left];
+            break;
+        case OpCode::Divide:
+            a[left] += seed / r[right];
+            a[right] -= seed * r[i] / r[right];
+            break;
+        case OpCode::Negate:
+            a[left] -= seed;
+            break;
+        case OpCode::Square:
+            a[left] += seed * ( r[left] + r[left] );
+            break;
+        case OpCode::Cube:
+            a[left] += seed * 3 * r[left] * r[left];
+            break;
+        case OpCode::SquareRoot:
+            a[left] += seed / ( r[i] + r[i] );
+            break;
+        case OpCode::Sin:
+            a[left] += seed * ( right < 0 ? std::cos( r[left] ) : r[right] );
+            break;
+        case OpCode::Cos:
+            a[left] -= seed * ( right < 0 ? std::sin( r[left] ) : r[right] );
+            break;
+        }
+    }
+}
+
+Jacobian Program::jacobian( std::span< const double > inputs ) const
+{
+    std::vector< double > values( outputs_.size() );
+    std::vector< double > matrix( outputs_.size() * variables_.size() );
+    std::vector< double > workspace( 2 * instructions_.size() );
+    jacobian( inputs, values, matrix, workspace );
+    return Jacobian{ variables_, std::move( values ), std::move( matrix ) };
+}
+
+void Program::jacobian( std::span< const double > inputs, std::span< double > values, std::span< double > jacobian,
+    std::span< double > workspace ) const
+{
+    const auto rows = outputs_.size();
+    const auto cols = variables_.size();
+    if ( values.size() != rows || jacobian.size() != rows * cols )
+    {
+        throw std::invalid_argument( "Jacobian size does not match the number of outputs and variables" );
+    }
+    if ( workspace.size() < 2 * instructions_.size() )
+    {
+        throw std::invalid_argument( "Not enough workspace" );
+    }
+
+    const auto size = instructions_.size();
+    eval( inputs, workspace.first( size ) );
+    std::fill( jacobian.begin(), jacobian.end(), 0.0 );
+    for ( size_t k = 0; k < rows; ++k )
+    {
+        values[k] = workspace[outputs_[k]];
+        backward( workspace.data(), workspace.data() + size, outputs_[k], jacobian.subspan( k * cols, cols ) );
+    }
+}
+
+double Jacobian::at( const int i, const std::string& name ) const
+{
+    const auto iter = std::find( variables_.begin(), variables_.end(), name );
+    if ( iter == variables_.end() )
+    {
+        throw std::invalid_argument( "Unknown variable " + name );
+    }
+    return ( *this )( i, static_cast< int >( std::distance( variables_.begin(), iter ) ) );
+}
+
+
+size_t ProgramBuilder::Hash::operator()( const Instruction& instruction ) const
+{
+    const auto code = static_cast< size_t >( instruction.code );
+    const auto left = static_cast< size_t >( static_cast< unsigned >( instruction.left ) );
+    const auto right = static_cast< size_t >( static_cast< unsigned >( instruction.right ) );
+    return ( code * 0x9E3779B97F4A7C15ull ) ^ ( left * 0xC2B2AE3D27D4EB4Full ) ^ ( right + ( right << 32 ) );
+}
+
+int ProgramBuilder::constant( double value )
+{
+    const auto bits = std::bit_cast< std::uint64_t >( value );
+    auto [iter, inserted] = constant_index_.try_emplace( bits, static_cast< int >( constants_.size() ) );
+    if ( inserted )
+    {
+        constants_.push_back( value );
+    }
+    return append( { OpCode::Constant, iter->second, -1 } );
+}
+
+int ProgramBuilder::variable( const std::string& name, double value )
+{
+    const auto [iter, inserted] = variable_index_.try_emplace( name, static_cast< int >( variables_.size() ) );
+    const auto slot = iter->second;
+    if ( inserted )
+    {
+        variables_.push_back( name );
+        values_.push_back( value );
+    }
+    else if ( values_[slot] != value && !( std::isnan( values_[slot] ) && std::isnan( value ) ) )
+    {
+        throw std::invalid_argument( "Variable " + name + " already has a different value" );
+    }
+    return append( { OpCode::Variable, slot, -1 } );
+}
+
+int ProgramBuilder::apply( OpCode code, int left, int right )
+{
+    const auto size = static_cast< int >( instructions_.size() );
+    const auto binary = code == OpCode::Add || code == OpCode::Subtract || code == OpCode::Multiply
+        || code == OpCode::Divide;
+    if ( code == OpCode::Constant || code == OpCode::Variable || left < 0 || left >= size
+        || ( binary && ( right < 0 || right >= size ) ) )
+    {
+        throw std::invalid_argument( "Invalid instruction operands" );
+    }
+    return append( { code, left, binary ? right : -1 } );
+}
+
+Program ProgramBuilder::build( int output ) const
+{
+    return Program{ instructions_, constants_, variables_, values_, output };
+}
+
+Program ProgramBuilder::build( std::vector< int > outputs ) const
+{
+    return Program{ instructions_, constants_, variables_, values_, std::move( outputs ) };
+}
+
+int ProgramBuilder::append( const Instruction& instruction )
+{
+    const auto [iter, inserted] = index_.try_emplace( instruction, static_cast< int >( instructions_.size() ) );
+    if ( inserted )
+    {
+        instructions_.push_back( instruction );
+    }
+    return iter->second;
+}
+
+} // namespace metal
@@ -0,0 +1,298 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_PROGRAM_HPP
+#define METAL_PROGRAM_HPP
+
+#include "Core.hpp"
+#include <span>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+
+namespace metal
+{
+
+enum class OpCode : std::uint8_t
+{
+    Constant,
+    Variable,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Negate,
+    Square,
+    Cube,
+    SquareRoot,
+    Sin,
+    Cos
+};
+
+/**
+ * Single step of a program, the result is written to the register with the index of the instruction.
+ * A sine and a cosine of the same register are linked through right, both are computed by the first.
+ */
+struct Instruction
+{
+    OpCode code;
+    int left;
+    int right;
+
+    friend bool operator==( const Instruction&, const Instruction& ) = default;
+};
+
+
+class Jacobian;
+
+/**
+ * Expression linearized into a topologically sorted array of instructions, each subexpression
+ * appearing only once. Evaluation is a single loop over the instructions. A program may have
+ * several outputs sharing their subexpressions, the first one is the result of eval().
+ */
+class Program
+{
+public:
+    Program( std::vector< Instruction > instructions, std::vector< double > constants,
+        std::vector< std::string > variables, std::vector< double > values, int output );
+
+    Program( std::vector< Instruction > instructions, std::vector< double > constants,
+        std::vector< std::string > variables, std::vector< double > values, std::vector< int > outputs );
+
+    const std::vector< Instruction >& instructions() const { return instructions_; }
+    const std::vector< double >& constants() const { return constants_; }
+    const std::vector< std::string >& variables() const { return variables_; }
+    const std::vector< double >& values() const { return values_; }
+    int output() const { return outputs_.front(); }
+    const std::vector< int >& outputs() const { return outputs_; }
+
+    /** Number of registers needed for evaluation */
+    int size() const { return static_cast< int >( instructions_.size() ); }
+
+    /** Evaluate with the values the variables had when the program was compiled */
+    double eval() const;
+
+    /** Evaluate with one input value per variable, in the order of variables() */
+    double eval( std::span< const double > inputs ) const;
+
+    /** Evaluate without allocating, using caller provided registers of at least size() elements */
+    double eval( std::span< const double > inputs, std::span< double > registers ) const;
+
+    /**
+     * Evaluate and write the derivatives with respect to the variables into gradient, with a
+     * reverse sweep over the instructions
+     */
+    double gradient( std::span< const double > inputs, std::span< double > gradient ) const;
+
+    /** Gradient without allocating, using a caller provided workspace of at least 2 * size() elements */
+    double gradient(
+        std::span< const double > inputs, std::span< double > gradient, std::span< double > workspace ) const;
+
+    /** Values of all outputs and their derivatives with respect to the variables */
+    Jacobian jacobian( std::span< const double > inputs ) const;
+
+    /**
+     * Jacobian without allocating, the values of the outputs and the rows of the derivatives are
+     * written to caller provided spans, using a workspace of at least 2 * size() elements. The
+     * forward sweep is shared, each output is differentiated with a reverse sweep.
+     */
+    void jacobian( std::span< const double > inputs, std::span< double > values, std::span< double > jacobian,
+        std::span< double > workspace ) const;
+
+private:
+    /** Throw if an operand, a constant, a variable or an output is out of range */
+    void validate() const;
+
+    /** Point the right operand of sines and cosines to their counterpart of the same argument, if any */
+    void link_siblings();
+
+    /** Accumulate the derivatives of an output into gradient, given the registers of the forward sweep */
+    void backward( const double* registers, double* adjoints, int output, std::span< double > gradient ) const;
+
+    std::vector< Instruction > instructions_;
+    std::vector< double > constants_;
+    std::vector< std::string > variables_;
+    std::vector< double > values_;
+    std::vector< int > outputs_;
+};
+
+
+/** Values of several outputs and their partial derivatives, stored row by row */
+class Jacobian
+{
+public:
+    Jacobian( std::vector< std::string > variables, std::vector< double > values, std::vector< double > matrix )
+        : variables_{ std::move( variables ) }
+        , values_{ std::move( values ) }
+        , matrix_{ std::move( matrix ) }
+    {
+    }
+
+    const std::vector< std::string >& variables() const { return variables_; }
+    const std::vector< double >& values() const { return values_; }
+    const std::vector< double >& matrix() const { return matrix_; }
+
+    int rows() const { return static_cast< int >( values_.size() ); }
+    int cols() const { return static_cast< int >( variables_.size() ); }
+
+    /** Derivative of the i-th output with respect to the j-th variable */
+    double operator()( const int i, const int j ) const { return matrix_[i * cols() + j]; }
+
+    /** Derivative of the i-th output with respect to the variable with the given name */
+    double at( int i, const std::string& name ) const;
+
+private:
+    std::vector< std::string > variables_;
+    std::vector< double > values_;
+    std::vector< double > matrix_;
+};
+
+
+/** Builds a program, storing structurally identical instructions only once */
+class ProgramBuilder
+{
+public:
+    int constant( double value );
+
+    /** Register of a variable, throws if the name was already given a different value */
+    int variable( const std::string& name, double value );
+
+    int apply( OpCode code, int left, int right = -1 );
+
+    Program build( int output ) const;
+    Program build( std::vector< int > outputs ) const;
+
+private:
+    struct Hash
+    {
+        size_t operator()( const Instruction& instruction ) const;
+    };
+
+    int append( const Instruction& instruction );
+
+    std::vector< Instruction > instructions_;
+    std::vector< double > constants_;
+    std::vector< std::string > variables_;
+    std::vector< double > values_;
+    std::unordered_map< Instruction, int, Hash > index_;
+    std::unordered_map< std::uint64_t, int > constant_index_;
+    std::unordered_map< std::string, int > variable_index_;
+};
+
+
+namespace detail
+{
+
+template< typename Operator >
+struct OpCodeOf;
+
+template<>
+struct OpCodeOf< AddOp > : std::integral_constant< OpCode, OpCode::Add >
+{
+};
+
+template<>
+struct OpCodeOf< SubtractOp > : std::integral_constant< OpCode, OpCode::Subtract >
+{
+};
+
+template<>
+struct OpCodeOf< MultiplyOp > : std::integral_constant< OpCode, OpCode::Multiply >
+{
+};
+
+template<>
+struct OpCodeOf< DivideOp > : std::integral_constant< OpCode, OpCode::Divide >
+{
+};
+
+template<>
+struct OpCodeOf< NegateOp > : std::integral_constant< OpCode, OpCode::Negate >
+{
+};
+
+template<>
+struct OpCodeOf< SquareOp > : std::integral_constant< OpCode, OpCode::Square >
+{
+};
+
+template<>
+struct OpCodeOf< CubeOp > : std::integral_constant< OpCode, OpCode::Cube >
+{
+};
+
+template<>
+struct OpCodeOf< SquareRootOp > : std::integral_constant< OpCode, OpCode::SquareRoot >
+{
+};
+
+template<>
+struct OpCodeOf< SinOp > : std::integral_constant< OpCode, OpCode::Sin >
+{
+};
+
+template<>
+struct OpCodeOf< CosOp > : std::integral_constant< OpCode, OpCode::Cos >
+{
+};
+
+template< typename Expr >
+int emit( ProgramBuilder& builder, const Expr& expr )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        const auto left = emit( builder, expr.left() );
+        const auto right = emit( builder, expr.right() );
+        return builder.apply( OpCodeOf< typename Expr::OperatorType >::value, left, right );
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        const auto input = emit( builder, expr.input() );
+        return builder.apply( OpCodeOf< typename Expr::OperatorType >::value, input );
+    }
+    else if constexpr ( VariableNode< Expr > )
+    {
+        return builder.variable( Expr::Name.value, expr.eval() );
+    }
+    else
+    {
+        return builder.constant( expr.eval() );
+    }
+}
+
+} // detail
+
+
+/** Compile an expression into a program that can be stored and evaluated at runtime */
+template< typename Input >
+Program compile( const Input& input )
+{
+    ProgramBuilder builder;
+    const auto output = detail::emit( builder, input );
+    return builder.build( output );
+}
+
+/** Compile several expressions into one program, subexpressions they share are computed once */
+template< typename... Inputs >
+Program compile( const std::tuple< Inputs... >& inputs )
+{
+    static_assert( sizeof...( Inputs ) > 0 );
+    ProgramBuilder builder;
+    std::vector< int > outputs;
+    std::apply( [&]( const auto&... input ) { ( outputs.push_back( detail::emit( builder, input ) ), ... ); }, inputs );
+    return builder.build( std::move( outputs ) );
+}
+
+/** Values and Jacobian of several expressions, evaluated together with the values they were built with */
+template< typename... Inputs >
+Jacobian jacobian( const std::tuple< Inputs... >& inputs )
+{
+    const auto program = compile( inputs );
+    return program.jacobian( program.values() );
+}
+
+} // namespace metal
+
+#endif
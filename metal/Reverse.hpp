@@ -0,0 +1,234 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_REVERSE_HPP
+#define METAL_REVERSE_HPP
+
+#include "Common.hpp"
+#include "Variable.hpp"
+#include <array>
+#include <tuple>
+
+
+namespace metal
+{
+
+namespace detail
+{
+
+/** Values of all nodes of an expression, mirroring its structure */
+template< typename Expr, typename Env >
+using ValueOf = decltype( std::declval< const Expr& >().eval( std::declval< const Env& >() ) );
+
+template< typename Expr, typename Env >
+struct Primal
+{
+    ValueOf< Expr, Env > value;
+};
+
+template< BinaryNode Expr, typename Env >
+struct Primal< Expr, Env >
+{
+    Primal< typename Expr::LeftType, Env > left;
+    Primal< typename Expr::RightType, Env > right;
+    ValueOf< Expr, Env > value;
+};
+
+template< UnaryNode Expr, typename Env >
+struct Primal< Expr, Env >
+{
+    Primal< typename Expr::InputType, Env > input;
+    ValueOf< Expr, Env > value;
+};
+
+/** Unary node whose operator yields its derivative together with its value at little extra cost */
+template< typename Expr, typename Env >
+concept FusedUnaryNode = UnaryNode< Expr > && requires( const ValueOf< typename Expr::InputType, Env >& input )
+{
+    Expr::OperatorType::apply_with_deriv( input );
+};
+
+template< typename Expr, typename Env >
+requires FusedUnaryNode< Expr, Env >
+struct Primal< Expr, Env >
+{
+    Primal< typename Expr::InputType, Env > input;
+    ValueOf< Expr, Env > value;
+    ValueOf< Expr, Env > deriv;
+};
+
+template< typename Expr, typename Env >
+constexpr Primal< Expr, Env > forward( const Expr& expr, const Env& env )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        using Operator = typename Expr::OperatorType;
+        auto left = forward( expr.left(), env );
+        auto right = forward( expr.right(), env );
+        const auto value = Operator::apply( left.value, right.value );
+        return { left, right, value };
+    }
+    else if constexpr ( FusedUnaryNode< Expr, Env > )
+    {
+        using Operator = typename Expr::OperatorType;
+        auto input = forward( expr.input(), env );
+        const auto [value, deriv] = Operator::apply_with_deriv( input.value );
+        return { input, value, deriv };
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        using Operator = typename Expr::OperatorType;
+        auto input = forward( expr.input(), env );
+        const auto value = Operator::apply( input.value );
+        return { input, value };
+    }
+    else
+    {
+        return { expr.eval( env ) };
+    }
+}
+
+template< typename Expr, typename Env, typename Seed, typename Adjoints >
+constexpr void backward( const Primal< Expr, Env >& primal, const Seed& seed, Adjoints& adjoints )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        using Operator = typename Expr::OperatorType;
+        const auto [left, right] = Operator::adjoint( primal.left.value, primal.right.value, primal.value, seed );
+        backward< typename Expr::LeftType, Env >( primal.left, left, adjoints );
+        backward< typename Expr::RightType, Env >( primal.right, right, adjoints );
+    }
+    else if constexpr ( FusedUnaryNode< Expr, Env > )
+    {
+        backward< typename Expr::InputType, Env >( primal.input, seed * primal.deriv, adjoints );
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        using Operator = typename Expr::OperatorType;
+        const auto input = Operator::adjoint( primal.input.value, primal.value, seed );
+        backward< typename Expr::InputType, Env >( primal.input, input, adjoints );
+    }
+    else if constexpr ( VariableNode< Expr > )
+    {
+        adjoints.template at< Expr::Name >() += seed;
+    }
+}
+
+/** Value of the variable with the given name in an expression */
+template< typename Var, typename Expr, typename Env >
+constexpr void lookup( const Expr& expr, const Env& env, ValueOf< Var, Env >& value )
+{
+    if constexpr ( BinaryNode< Expr > )
+    {
+        lookup< Var >( expr.left(), env, value );
+        lookup< Var >( expr.right(), env, value );
+    }
+    else if constexpr ( UnaryNode< Expr > )
+    {
+        lookup< Var >( expr.input(), env, value );
+    }
+    else if constexpr ( VariableNode< Expr > )
+    {
+        if constexpr ( Expr::Name == Var::Name )
+        {
+            value = expr.eval( env );
+        }
+    }
+}
+
+/** Position of the variable with the given name among the variables */
+template< StringLiteral Name, typename... Vars >
+constexpr size_t index_of()
+{
+    constexpr std::array< bool, sizeof...( Vars ) > match{ ( Vars::Name == Name )... };
+    constexpr auto result = []( const auto& match )
+    {
+        size_t i = 0;
+        while ( i < match.size() && !match[i] )
+        {
+            ++i;
+        }
+        return i;
+    }( match );
+    static_assert( result < sizeof...( Vars ), "Variable does not appear in the expression" );
+    return result;
+}
+
+} // detail
+
+
+/** Value of an expression together with its partial derivative for each variable */
+template< typename Value, typename Variables >
+class Partials;
+
+template< typename Value, typename... Vars >
+class Partials< Value, detail::TypeList< Vars... > >
+{
+public:
+    static constexpr auto Size = sizeof...( Vars );
+
+    constexpr Partials( const Value& value )
+        : value_{ value }
+        , partials_{}
+    {
+    }
+
+    constexpr Partials( const Value& value, const std::array< Value, Size >& partials )
+        : value_{ value }
+        , partials_{ partials }
+    {
+    }
+
+    constexpr const Value& value() const { return value_; }
+
+    template< detail::StringLiteral Name >
+    constexpr const Value& at() const
+    {
+        return partials_[index< Name >()];
+    }
+
+    template< detail::StringLiteral Name >
+    constexpr Value& at()
+    {
+        return partials_[index< Name >()];
+    }
+
+    template< typename Var >
+    constexpr const Value& at( const Var& ) const
+    {
+        return at< Var::Name >();
+    }
+
+    constexpr const std::array< Value, Size >& partials() const { return partials_; }
+
+private:
+    template< detail::StringLiteral Name >
+    static constexpr size_t index()
+    {
+        return detail::index_of< Name, Vars... >();
+    }
+
+    Value value_;
+    std::array< Value, Size > partials_;
+};
+
+
+/** Value and all partial derivatives of an expression with one forward and one backward sweep */
+template< typename Input, typename Env >
+constexpr auto gradient( const Input& input, const Env& env )
+{
+    using Value = detail::ValueOf< Input, Env >;
+    const auto primal = detail::forward( input, env );
+    Partials< Value, detail::Variables< Input > > result{ primal.value };
+    detail::backward< Input, Env >( primal, Value{ 1 }, result );
+    return result;
+}
+
+template< typename Input >
+constexpr auto gradient( const Input& input )
+{
+    return gradient( input, detail::Unbound{} );
+}
+
+} // metal
+
+#endif
@@ -1,7 +1,11 @@
 /** Copyright Gabor Varga 2023 */
 
+#ifndef METAL_SCALAR_GRADIENT_HPP
+#define METAL_SCALAR_GRADIENT_HPP
+
 #include "Parameter.hpp"
 #include "Util.hpp"
+#include "SmallVector.hpp"
 
 #include <array>
 #include <vector>
@@ -43,15 +47,25 @@ public:
 // };
 
 
-template< typename T_, int Size_ >
+/**
+ * Values of derivatives with respect to a sorted list of parameters. Size is the number of
+ * parameters or -1 if it is dynamic, in which case up to Inline parameters, at least one, are
+ * stored inside the object. Larger dynamic gradients are allocated from the current arena, or the
+ * heap outside of an ArenaScope.
+ */
+template< typename T_, int Size_, int Inline_ = 0 >
 class Gradient// : public GradientBase< Gradient< T_, Size_ > >
 {
 public:
     using T = T_;
     static constexpr int Size = Size_;
+    static constexpr int Inline = Inline_;
+
+    template< typename S >
+    using Dynamic = SmallVector< S, std::max( Inline, 1 ) >;
 
     template< typename S >
-    using Holder = std::conditional_t< Size == -1, std::vector< S >, std::array< S, Size > >;
+    using Holder = std::conditional_t< Size == -1, Dynamic< S >, std::array< S, Size > >;
 
     using Parameters = Holder< Parameter >;
     using Value = Holder< T >;
@@ -66,11 +80,12 @@ public:
     }
 
     const Parameters& parameters() const { return parameters_; }
+    const Value& value() const { return value_; }
 
     const T& at( const Parameter& p ) const
     {
         const auto iter = std::ranges::lower_bound( parameters_, p );
-        check< ParameterNotFoundException >( iter != parameters_.end(), p );
+        check< ParameterNotFoundException >( iter != parameters_.end() && *iter == p, p );
         const auto id = std::distance( parameters_.begin(), iter );
         return value_[id];
     }
@@ -78,7 +93,7 @@ public:
     T& at( const Parameter& p )
     {
         const auto iter = std::ranges::lower_bound( parameters_, p );
-        check< ParameterNotFoundException >( iter != parameters_.end(), p );
+        check< ParameterNotFoundException >( iter != parameters_.end() && *iter == p, p );
         const auto id = std::distance( parameters_.begin(), iter );
         return value_[id];
     }
@@ -89,16 +104,198 @@ private:
 };
 
 
-// template< typename T, int Size, typename Op >
-// class GradientBinaryOp
-// {
+namespace detail
+{
 
-// };
+/** Number of distinct parameters in two sorted lists */
+template< typename Left, typename Right >
+size_t union_size( const Left& left, const Right& right )
+{
+    const size_t left_size = left.size();
+    const size_t right_size = right.size();
+    size_t common = 0;
+    for ( size_t i = 0, j = 0; i < left_size && j < right_size; )
+    {
+        if ( left[i] < right[j] )
+        {
+            ++i;
+        }
+        else if ( right[j] < left[i] )
+        {
+            ++j;
+        }
+        else
+        {
+            ++common;
+            ++i;
+            ++j;
+        }
+    }
+    return left_size + right_size - common;
+}
 
-// template< typename T, int Size1, int Size2 >
-// Gradient< T, Size > operator+( const Gradient< T, Size1 >& left, const Gradient< T, Size2 >& right )
-// {
+/**
+ * Result of merging two gradients. The union of the parameters is only known at runtime, so it is
+ * dynamically sized. Two fixed-size gradients bound it by the sum of their sizes, which is stored
+ * inline, otherwise the inline capacity of the left gradient is kept.
+ */
+template< typename T, int Size1, int Inline1, int Size2 >
+using MergedGradient = Gradient< T, -1, ( Size1 >= 0 && Size2 >= 0 ) ? Size1 + Size2 : Inline1 >;
 
-// }
+/**
+ * Merge the sorted parameter lists of two gradients in a single pass. Parameters found in only one
+ * of them are transformed with the unary functions, common ones with the binary function.
+ * Capacity is reserved once, for the worst case when it fits inline or there is no inline
+ * storage, otherwise for the union counted in an extra pass, so overlapping gradients whose union
+ * fits inline stay off the heap. Fixed-size gradients of the same size usually share their
+ * parameters, those are combined element by element.
+ */
+template< typename T, int Size1, int Inline1, int Size2, int Inline2, typename OnlyLeft, typename OnlyRight,
+    typename Both >
+MergedGradient< T, Size1, Inline1, Size2 > merge( const Gradient< T, Size1, Inline1 >& left,
+    const Gradient< T, Size2, Inline2 >& right, OnlyLeft only_left, OnlyRight only_right, Both both )
+{
+    const auto& left_parameters = left.parameters();
+    const auto& right_parameters = right.parameters();
+    const auto& left_value = left.value();
+    const auto& right_value = right.value();
+    const size_t left_size = left_parameters.size();
+    const size_t right_size = right_parameters.size();
+
+    using Result = MergedGradient< T, Size1, Inline1, Size2 >;
+    if constexpr ( Size1 == Size2 && Size1 >= 0 )
+    {
+        if ( std::ranges::equal( left_parameters, right_parameters ) )
+        {
+            typename Result::Parameters parameters( left_parameters.begin(), left_parameters.end() );
+            typename Result::Value value;
+            value.reserve( Size1 );
+            for ( int i = 0; i < Size1; ++i )
+            {
+                value.push_back( both( left_value[i], right_value[i] ) );
+            }
+            return Result{ std::move( parameters ), std::move( value ) };
+        }
+    }
+
+    auto capacity = left_size + right_size;
+    if ( Result::Inline > 0 && capacity > static_cast< size_t >( Result::Inline ) )
+    {
+        capacity = union_size( left_parameters, right_parameters );
+    }
+    typename Result::Parameters parameters;
+    typename Result::Value value;
+    parameters.reserve( static_cast< int >( capacity ) );
+    value.reserve( static_cast< int >( capacity ) );
+
+    size_t i = 0;
+    size_t j = 0;
+    while ( i < left_size && j < right_size )
+    {
+        if ( left_parameters[i] < right_parameters[j] )
+        {
+            parameters.push_back( left_parameters[i] );
+            value.push_back( only_left( left_value[i] ) );
+            ++i;
+        }
+        else if ( right_parameters[j] < left_parameters[i] )
+        {
+            parameters.push_back( right_parameters[j] );
+            value.push_back( only_right( right_value[j] ) );
+            ++j;
+        }
+        else
+        {
+            parameters.push_back( left_parameters[i] );
+            value.push_back( both( left_value[i], right_value[j] ) );
+            ++i;
+            ++j;
+        }
+    }
+    for ( ; i < left_size; ++i )
+    {
+        parameters.push_back( left_parameters[i] );
+        value.push_back( only_left( left_value[i] ) );
+    }
+    for ( ; j < right_size; ++j )
+    {
+        parameters.push_back( right_parameters[j] );
+        value.push_back( only_right( right_value[j] ) );
+    }
+    return Result{ std::move( parameters ), std::move( value ) };
+}
+
+/** Apply a function to every value, keeping the parameters and the size */
+template< typename T, int Size, int Inline, typename Function >
+Gradient< T, Size, Inline > transform( const Gradient< T, Size, Inline >& input, Function function )
+{
+    auto value = input.value();
+    for ( auto& v : value )
+    {
+        v = function( v );
+    }
+    return Gradient< T, Size, Inline >{ input.parameters(), std::move( value ) };
+}
+
+} // detail
+
+
+template< typename T, int Size1, int Inline1, int Size2, int Inline2 >
+detail::MergedGradient< T, Size1, Inline1, Size2 > operator+(
+    const Gradient< T, Size1, Inline1 >& left, const Gradient< T, Size2, Inline2 >& right )
+{
+    return detail::merge(
+        left, right, []( const T& x ) { return x; }, []( const T& y ) { return y; },
+        []( const T& x, const T& y ) { return x + y; } );
+}
+
+template< typename T, int Size1, int Inline1, int Size2, int Inline2 >
+detail::MergedGradient< T, Size1, Inline1, Size2 > operator-(
+    const Gradient< T, Size1, Inline1 >& left, const Gradient< T, Size2, Inline2 >& right )
+{
+    return detail::merge(
+        left, right, []( const T& x ) { return x; }, []( const T& y ) { return -y; },
+        []( const T& x, const T& y ) { return x - y; } );
+}
+
+template< typename T, int Size, int Inline >
+Gradient< T, Size, Inline > operator-( const Gradient< T, Size, Inline >& input )
+{
+    return detail::transform( input, []( const T& x ) { return -x; } );
+}
+
+template< typename T, int Size, int Inline >
+Gradient< T, Size, Inline > operator*( const Gradient< T, Size, Inline >& input, const T& a )
+{
+    return detail::transform( input, [&]( const T& x ) { return x * a; } );
+}
+
+template< typename T, int Size, int Inline >
+Gradient< T, Size, Inline > operator*( const T& a, const Gradient< T, Size, Inline >& input )
+{
+    return input * a;
+}
+
+/** a * x + y in one merge */
+template< typename T, int Size1, int Inline1, int Size2, int Inline2 >
+detail::MergedGradient< T, Size1, Inline1, Size2 > axpy(
+    const T& a, const Gradient< T, Size1, Inline1 >& x, const Gradient< T, Size2, Inline2 >& y )
+{
+    return detail::merge(
+        x, y, [&]( const T& u ) { return a * u; }, []( const T& v ) { return v; },
+        [&]( const T& u, const T& v ) { return a * u + v; } );
+}
+
+/** Chain rule update dx * a + dy * b of a Dual with Gradient derivatives in one merge */
+template< typename T, int Size1, int Inline1, int Size2, int Inline2 >
+detail::MergedGradient< T, Size1, Inline1, Size2 > chain(
+    const Gradient< T, Size1, Inline1 >& dx, const T& a, const Gradient< T, Size2, Inline2 >& dy, const T& b )
+{
+    return detail::merge(
+        dx, dy, [&]( const T& u ) { return u * a; }, [&]( const T& v ) { return v * b; },
+        [&]( const T& u, const T& v ) { return u * a + v * b; } );
+}
 
 } // namespace metal
+
+#endif
@@ -0,0 +1,74 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_SIN_COS_HPP
+#define METAL_SIN_COS_HPP
+
+#include <cmath>
+#include <utility>
+#include <type_traits>
+
+
+namespace metal
+{
+
+/** Sine and cosine of the same argument with a single library call */
+inline std::pair< double, double > sincos( const double x )
+{
+    double s;
+    double c;
+    __builtin_sincos( x, &s, &c );
+    return { s, c };
+}
+
+inline std::pair< float, float > sincos( const float x )
+{
+    float s;
+    float c;
+    __builtin_sincosf( x, &s, &c );
+    return { s, c };
+}
+
+inline std::pair< long double, long double > sincos( const long double x )
+{
+    long double s;
+    long double c;
+    __builtin_sincosl( x, &s, &c );
+    return { s, c };
+}
+
+
+namespace detail
+{
+
+/**
+ * Sine and cosine of the same argument, fused when the type provides a sincos found by argument
+ * dependent lookup, computed separately otherwise
+ */
+template< typename T >
+constexpr auto sin_cos( const T& x )
+{
+    if constexpr ( std::is_floating_point_v< T > )
+    {
+        if ( std::is_constant_evaluated() )
+        {
+            return std::pair< T, T >{ std::sin( x ), std::cos( x ) };
+        }
+        return metal::sincos( x );
+    }
+    else if constexpr ( requires { sincos( x ).first; } )
+    {
+        return sincos( x );
+    }
+    else
+    {
+        using std::sin;
+        using std::cos;
+        return std::pair{ sin( x ), cos( x ) };
+    }
+}
+
+} // detail
+
+} // namespace metal
+
+#endif
@@ -1,51 +1,155 @@
 /** Copyright Gabor Varga 2023 */
 
-#include <array>
-#include <stdlib.h>
+#ifndef METAL_SMALL_VECTOR_HPP
+#define METAL_SMALL_VECTOR_HPP
+
+#include "Arena.hpp"
+
+#include <new>
+#include <cstddef>
+#include <memory>
+#include <cstring>
+#include <utility>
+#include <algorithm>
 #include <stdexcept>
+#include <type_traits>
+#include <initializer_list>
 
 
 namespace metal
 {
 
+/**
+ * Vector storing up to StackSize elements inside the object, switching to the heap only when it
+ * grows beyond that. Trivially copyable elements are relocated with memcpy. A vector constructed
+ * inside an ArenaScope takes its storage from that arena for its whole lifetime and must not outlive
+ * the scope, vectors constructed outside use the heap even when they grow or are assigned in a scope.
+ */
 template< typename T, int StackSize_ >
 class SmallVector
 {
 public:
     static_assert( StackSize_ > 0 );
+    static_assert( alignof( T ) <= alignof( std::max_align_t ) );
 
     static constexpr int StackSize = StackSize_;
 
-    enum class Mode
-    {
-        Stack,
-        Heap
-    };
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
 
     /** Default constructor*/
     SmallVector()
-        : mode_{ Mode::Stack }
-        , heap_{ nullptr }
-        , data_{ &stack_[0] }
+        : data_{ stack() }
         , capacity_{ StackSize }
         , size_{ 0 }
+        , arena_{ current_arena() }
     {
     }
 
-    /** Sized constructor */
+    /** Sized constructor, elements are value initialized */
     explicit SmallVector( const int size )
-        : mode_{ size > StackSize ? Mode::Heap : Mode::Stack }
-        , heap_{ mode_ == Mode::Heap ? malloc( sizeof( T ) * size ) : nullptr }
-        , data_{ mode_ == Mode::Heap ? heap_ : &stack_[0] }
-        , capacity_{ mode_ == Mode::Heap ? size : StackSize }
-        , size_{ size }
+        : SmallVector{}
+    {
+        resize( size );
+    }
+
+    SmallVector( const int size, const T& value )
+        : SmallVector{}
+    {
+        reserve( size );
+        std::uninitialized_fill_n( data_, size, value );
+        size_ = size;
+    }
+
+    SmallVector( std::initializer_list< T > values )
+        : SmallVector( values.begin(), values.end() )
+    {
+    }
+
+    template< typename Iterator >
+    requires( !std::is_integral_v< Iterator > )
+    SmallVector( Iterator first, Iterator last )
+        : SmallVector{}
+    {
+        const auto size = static_cast< int >( std::distance( first, last ) );
+        reserve( size );
+        std::uninitialized_copy( first, last, data_ );
+        size_ = size;
+    }
+
+    SmallVector( const SmallVector& other )
+        : SmallVector( other.begin(), other.end() )
+    {
+    }
+
+    /** Storage is taken over together with its source, inline elements are relocated */
+    SmallVector( SmallVector&& other ) noexcept( std::is_nothrow_move_constructible_v< T > )
+        : SmallVector{}
+    {
+        arena_ = other.arena_;
+        take( std::move( other ) );
+    }
+
+    ~SmallVector()
+    {
+        std::destroy_n( data_, size_ );
+        release();
+    }
+
+    SmallVector& operator=( const SmallVector& other )
     {
+        if ( this != &other )
+        {
+            clear();
+            reserve( other.size_ );
+            std::uninitialized_copy_n( other.data_, other.size_, data_ );
+            size_ = other.size_;
+        }
+        return *this;
+    }
+
+    /** Storage from a different source is copied, so the vector keeps allocating from its own */
+    SmallVector& operator=( SmallVector&& other )
+    {
+        if ( this != &other )
+        {
+            clear();
+            if ( other.arena_ == arena_ || other.is_inline() )
+            {
+                release();
+                data_ = stack();
+                capacity_ = StackSize;
+                take( std::move( other ) );
+            }
+            else
+            {
+                reserve( other.size_ );
+                relocate( other.data_, other.size_, data_ );
+                size_ = other.size_;
+                other.size_ = 0;
+            }
+        }
+        return *this;
     }
 
     /** Member access */
     const T* data() const { return data_; }
+    T* data() { return data_; }
     int capacity() const { return capacity_; }
     int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /** Whether the elements are stored inside the object */
+    bool is_inline() const { return data_ == stack(); }
+
+    /** Arena the storage is taken from, nullptr for the heap */
+    Arena* arena() const { return arena_; }
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
 
     /** Unsafe element access */
     const T& operator[]( const int i ) const { return data_[i]; }
@@ -54,25 +158,140 @@ public:
     /** Safe element access */
     const T& at( const int i ) const
     {
-        if ( i >= size_ )
+        if ( i < 0 || i >= size_ )
             throw std::runtime_error( "Invalid index" );
         return data_[i];
     }
     T& at( const int i )
     {
-        if ( i >= size_ )
+        if ( i < 0 || i >= size_ )
             throw std::runtime_error( "Invalid index" );
         return data_[i];
     }
 
+    const T& front() const { return data_[0]; }
+    T& front() { return data_[0]; }
+    const T& back() const { return data_[size_ - 1]; }
+    T& back() { return data_[size_ - 1]; }
+
+    /** Make room for at least capacity elements without further allocation */
+    void reserve( const int capacity )
+    {
+        if ( capacity > capacity_ )
+        {
+            reallocate( capacity );
+        }
+    }
+
+    void resize( const int size )
+    {
+        if ( size < size_ )
+        {
+            std::destroy( data_ + size, data_ + size_ );
+        }
+        else
+        {
+            reserve( size );
+            std::uninitialized_value_construct( data_ + size_, data_ + size );
+        }
+        size_ = size;
+    }
+
+    template< typename... Args >
+    T& emplace_back( Args&&... args )
+    {
+        if ( size_ == capacity_ )
+        {
+            // Arguments may refer to an element, construct the new one before relocating
+            T value( std::forward< Args >( args )... );
+            reallocate( 2 * capacity_ );
+            return *new ( data_ + size_++ ) T( std::move( value ) );
+        }
+        return *new ( data_ + size_++ ) T( std::forward< Args >( args )... );
+    }
+
+    void push_back( const T& value ) { emplace_back( value ); }
+    void push_back( T&& value ) { emplace_back( std::move( value ) ); }
+
+    void pop_back() { std::destroy_at( data_ + --size_ ); }
+
+    /** Destroy the elements, keeping the capacity */
+    void clear()
+    {
+        std::destroy_n( data_, size_ );
+        size_ = 0;
+    }
+
+    friend bool operator==( const SmallVector& left, const SmallVector& right )
+    {
+        return std::equal( left.begin(), left.end(), right.begin(), right.end() );
+    }
+
 private:
-    // std::array< T, StackSize > stack_;
-    T stack_[StackSize];
-    Mode mode_;
-    T* heap_;
+    static constexpr bool Relocatable = std::is_trivially_copyable_v< T >;
+
+    const T* stack() const { return reinterpret_cast< const T* >( stack_ ); }
+    T* stack() { return reinterpret_cast< T* >( stack_ ); }
+
+    /** Move count elements into uninitialized memory and destroy the originals */
+    static void relocate( T* from, const int count, T* to )
+    {
+        if constexpr ( Relocatable )
+        {
+            if ( count > 0 )
+            {
+                std::memcpy( static_cast< void* >( to ), from, sizeof( T ) * count );
+            }
+        }
+        else
+        {
+            std::uninitialized_move_n( from, count, to );
+            std::destroy_n( from, count );
+        }
+    }
+
+    void reallocate( const int capacity )
+    {
+        auto* heap = static_cast< T* >( detail::allocate( sizeof( T ) * capacity, arena_ ) );
+        relocate( data_, size_, heap );
+        release();
+        data_ = heap;
+        capacity_ = capacity;
+    }
+
+    void release()
+    {
+        if ( !is_inline() )
+        {
+            detail::deallocate( data_, arena_ );
+        }
+    }
+
+    /** Take the elements of other, which must be empty afterwards and this must be empty before */
+    void take( SmallVector&& other )
+    {
+        if ( other.is_inline() )
+        {
+            relocate( other.data_, other.size_, data_ );
+        }
+        else
+        {
+            data_ = other.data_;
+            capacity_ = other.capacity_;
+            other.data_ = other.stack();
+            other.capacity_ = StackSize;
+        }
+        size_ = other.size_;
+        other.size_ = 0;
+    }
+
+    alignas( T ) std::byte stack_[sizeof( T ) * StackSize];
     T* data_;
     int capacity_;
     int size_;
+    Arena* arena_;
 };
 
 } // namespace metal
+
+#endif
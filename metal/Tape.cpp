@@ -0,0 +1,11 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Tape.hpp"
+
+
+namespace metal
+{
+
+template class BasicTape< double >;
+
+} // namespace metal
@@ -0,0 +1,414 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_TAPE_HPP
+#define METAL_TAPE_HPP
+
+#include "ScalarGradient.hpp"
+#include "SinCos.hpp"
+
+#include <span>
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+
+namespace metal
+{
+
+template< typename T >
+class BasicTape;
+
+/** Scalar whose operations are recorded on a tape for reverse mode differentiation */
+template< typename T >
+class BasicActive
+{
+public:
+    using Value = T;
+
+    BasicActive( BasicTape< T >& tape, const int index, T value )
+        : tape_{ &tape }
+        , index_{ index }
+        , value_{ std::move( value ) }
+    {
+    }
+
+    BasicTape< T >& tape() const { return *tape_; }
+    int index() const { return index_; }
+    const T& value() const { return value_; }
+
+private:
+    BasicTape< T >* tape_;
+    int index_;
+    T value_;
+};
+
+
+/**
+ * Recording of the operations on active scalars, each one stored with the local partial derivatives
+ * with respect to its at most two operands. A backward sweep yields the gradient with respect to
+ * the parameters the inputs were created for.
+ *
+ * Segments recorded with checkpoint() store only their inputs and outputs, the operations inside
+ * are recorded again on a temporary tape during the backward sweep. Tape memory of a loop is then
+ * bounded by the number of iterations plus the size of a single iteration.
+ *
+ * Values are usually double. With Dual values the backward sweep propagates their derivatives as
+ * well, which gives second derivatives forward over reverse.
+ */
+template< typename T >
+class BasicTape
+{
+public:
+    using Value = T;
+    using Active = BasicActive< T >;
+
+    /** Computation of a segment, recording its operations on the tape of its inputs */
+    using Segment = std::function< std::vector< Active >( std::span< const Active > ) >;
+
+    /** Independent input with respect to the given parameter */
+    Active variable( const Parameter& p, T value );
+
+    /** Record an operation with its value and partial derivatives, right is -1 for unary ones */
+    Active record( T value, int left, T dleft, int right = -1, T dright = T{} );
+
+    /** Apply a segment to the inputs, recording only its outputs */
+    std::vector< Active > checkpoint( std::span< const Active > inputs, Segment segment );
+
+    /** Number of recorded entries */
+    int size() const { return static_cast< int >( entries_.size() ); }
+
+    void reserve( int size ) { entries_.reserve( size ); }
+
+    /** Forget every recording, active scalars of this tape are invalidated */
+    void clear();
+
+    /** Derivatives of the output with respect to the parameters of the inputs */
+    Gradient< T, -1 > gradient( const Active& output ) const;
+
+private:
+    struct Entry
+    {
+        int left;
+        int right;
+        T dleft;
+        T dright;
+    };
+
+    struct Checkpoint
+    {
+        Segment segment;
+        std::vector< int > inputs;
+        std::vector< T > values;
+        int first;
+        int size;
+    };
+
+    Active leaf( T value );
+
+    /** Adjoints of every entry for the given seeds of the outputs */
+    std::vector< T > adjoints( std::span< const int > outputs, std::span< const T > seeds ) const;
+
+    std::vector< Entry > entries_;
+    std::vector< Checkpoint > checkpoints_;
+    std::vector< std::pair< Parameter, int > > variables_;
+};
+
+using Tape = BasicTape< double >;
+using Active = BasicActive< double >;
+
+
+template< typename T >
+BasicActive< T > BasicTape< T >::variable( const Parameter& p, T value )
+{
+    const auto result = leaf( std::move( value ) );
+    variables_.emplace_back( p, result.index() );
+    return result;
+}
+
+template< typename T >
+BasicActive< T > BasicTape< T >::record( T value, int left, T dleft, int right, T dright )
+{
+    entries_.push_back( Entry{ left, right, std::move( dleft ), std::move( dright ) } );
+    return Active{ *this, size() - 1, std::move( value ) };
+}
+
+template< typename T >
+BasicActive< T > BasicTape< T >::leaf( T value )
+{
+    return record( std::move( value ), -1, T{} );
+}
+
+template< typename T >
+std::vector< BasicActive< T > > BasicTape< T >::checkpoint( std::span< const Active > inputs, Segment segment )
+{
+    Checkpoint checkpoint{ std::move( segment ), {}, {}, size(), 0 };
+    checkpoint.inputs.reserve( inputs.size() );
+    checkpoint.values.reserve( inputs.size() );
+    for ( const auto& input : inputs )
+    {
+        if ( &input.tape() != this )
+        {
+            throw std::invalid_argument( "Active scalars belong to different tapes" );
+        }
+        checkpoint.inputs.push_back( input.index() );
+        checkpoint.values.push_back( input.value() );
+    }
+
+    // Run the segment on a temporary tape, only its outputs are kept
+    std::vector< Active > outputs;
+    {
+        BasicTape local;
+        std::vector< Active > locals;
+        for ( const auto& value : checkpoint.values )
+        {
+            locals.push_back( local.leaf( value ) );
+        }
+        for ( const auto& output : checkpoint.segment( locals ) )
+        {
+            outputs.push_back( leaf( output.value() ) );
+        }
+    }
+    // A segment without outputs does not contribute to any derivative
+    if ( !outputs.empty() )
+    {
+        checkpoint.first = outputs.front().index();
+        checkpoint.size = static_cast< int >( outputs.size() );
+        checkpoints_.push_back( std::move( checkpoint ) );
+    }
+    return outputs;
+}
+
+template< typename T >
+void BasicTape< T >::clear()
+{
+    entries_.clear();
+    checkpoints_.clear();
+    variables_.clear();
+}
+
+template< typename T >
+std::vector< T > BasicTape< T >::adjoints( std::span< const int > outputs, std::span< const T > seeds ) const
+{
+    std::vector< T > adjoints( entries_.size() );
+    for ( size_t i = 0; i < outputs.size(); ++i )
+    {
+        adjoints[outputs[i]] += seeds[i];
+    }
+
+    // Checkpoints are sorted by their outputs, they are processed once the sweep reaches the first one
+    auto checkpoint = checkpoints_.rbegin();
+    for ( auto i = static_cast< int >( entries_.size() ) - 1; i >= 0; --i )
+    {
+        const auto& [left, right, dleft, dright] = entries_[i];
+        const T& seed = adjoints[i];
+        if ( left >= 0 )
+        {
+            adjoints[left] += seed * dleft;
+        }
+        if ( right >= 0 )
+        {
+            adjoints[right] += seed * dright;
+        }
+
+        while ( checkpoint != checkpoints_.rend() && checkpoint->first == i )
+        {
+            BasicTape local;
+            std::vector< Active > locals;
+            for ( const auto& value : checkpoint->values )
+            {
+                locals.push_back( local.leaf( value ) );
+            }
+            std::vector< int > local_outputs;
+            for ( const auto& output : checkpoint->segment( locals ) )
+            {
+                local_outputs.push_back( output.index() );
+            }
+            if ( static_cast< int >( local_outputs.size() ) != checkpoint->size )
+            {
+                throw std::logic_error( "Recomputed segment has a different number of outputs" );
+            }
+
+            const auto local_adjoints = local.adjoints(
+                local_outputs, std::span< const T >{ adjoints.data() + checkpoint->first, local_outputs.size() } );
+            for ( size_t k = 0; k < locals.size(); ++k )
+            {
+                adjoints[checkpoint->inputs[k]] += local_adjoints[locals[k].index()];
+            }
+            ++checkpoint;
+        }
+    }
+    return adjoints;
+}
+
+template< typename T >
+Gradient< T, -1 > BasicTape< T >::gradient( const Active& output ) const
+{
+    if ( &output.tape() != this )
+    {
+        throw std::invalid_argument( "Output belongs to a different tape" );
+    }
+
+    const int outputs[] = { output.index() };
+    const T seeds[] = { T( 1.0 ) };
+    const auto adjoints = this->adjoints( outputs, seeds );
+
+    auto variables = variables_;
+    std::ranges::sort( variables );
+    typename Gradient< T, -1 >::Parameters parameters;
+    typename Gradient< T, -1 >::Value value;
+    for ( const auto& [p, index] : variables )
+    {
+        // The same parameter may have several inputs, their contributions add up
+        if ( !parameters.empty() && parameters.back() == p )
+        {
+            value.back() += adjoints[index];
+        }
+        else
+        {
+            parameters.push_back( p );
+            value.push_back( adjoints[index] );
+        }
+    }
+    return Gradient< T, -1 >{ std::move( parameters ), std::move( value ) };
+}
+
+extern template class BasicTape< double >;
+
+
+namespace detail
+{
+
+template< typename T >
+BasicTape< T >& tape_of( const BasicActive< T >& left, const BasicActive< T >& right )
+{
+    if ( &left.tape() != &right.tape() )
+    {
+        throw std::invalid_argument( "Active scalars belong to different tapes" );
+    }
+    return left.tape();
+}
+
+} // detail
+
+
+template< typename T >
+BasicActive< T > operator+( const BasicActive< T >& x, const BasicActive< T >& y )
+{
+    return detail::tape_of( x, y ).record( x.value() + y.value(), x.index(), T( 1.0 ), y.index(), T( 1.0 ) );
+}
+
+template< typename T >
+BasicActive< T > operator-( const BasicActive< T >& x, const BasicActive< T >& y )
+{
+    return detail::tape_of( x, y ).record( x.value() - y.value(), x.index(), T( 1.0 ), y.index(), T( -1.0 ) );
+}
+
+template< typename T >
+BasicActive< T > operator*( const BasicActive< T >& x, const BasicActive< T >& y )
+{
+    return detail::tape_of( x, y ).record( x.value() * y.value(), x.index(), y.value(), y.index(), x.value() );
+}
+
+template< typename T >
+BasicActive< T > operator/( const BasicActive< T >& x, const BasicActive< T >& y )
+{
+    const T value = x.value() / y.value();
+    return detail::tape_of( x, y ).record( value, x.index(), 1.0 / y.value(), y.index(), -value / y.value() );
+}
+
+template< typename T >
+BasicActive< T > operator+( const BasicActive< T >& x, double y )
+{
+    return x.tape().record( x.value() + y, x.index(), T( 1.0 ) );
+}
+
+template< typename T >
+BasicActive< T > operator-( const BasicActive< T >& x, double y )
+{
+    return x.tape().record( x.value() - y, x.index(), T( 1.0 ) );
+}
+
+template< typename T >
+BasicActive< T > operator*( const BasicActive< T >& x, double y )
+{
+    return x.tape().record( x.value() * y, x.index(), T( y ) );
+}
+
+template< typename T >
+BasicActive< T > operator/( const BasicActive< T >& x, double y )
+{
+    return x.tape().record( x.value() / y, x.index(), T( 1.0 / y ) );
+}
+
+template< typename T >
+BasicActive< T > operator+( double x, const BasicActive< T >& y )
+{
+    return y + x;
+}
+
+template< typename T >
+BasicActive< T > operator-( double x, const BasicActive< T >& y )
+{
+    return y.tape().record( x - y.value(), y.index(), T( -1.0 ) );
+}
+
+template< typename T >
+BasicActive< T > operator*( double x, const BasicActive< T >& y )
+{
+    return y * x;
+}
+
+template< typename T >
+BasicActive< T > operator/( double x, const BasicActive< T >& y )
+{
+    const T value = x / y.value();
+    return y.tape().record( value, y.index(), -value / y.value() );
+}
+
+template< typename T >
+BasicActive< T > operator-( const BasicActive< T >& x )
+{
+    return x.tape().record( -x.value(), x.index(), T( -1.0 ) );
+}
+
+template< typename T >
+BasicActive< T > square( const BasicActive< T >& x )
+{
+    return x.tape().record( x.value() * x.value(), x.index(), x.value() + x.value() );
+}
+
+template< typename T >
+BasicActive< T > cube( const BasicActive< T >& x )
+{
+    const T square = x.value() * x.value();
+    return x.tape().record( square * x.value(), x.index(), 3.0 * square );
+}
+
+template< typename T >
+BasicActive< T > sqrt( const BasicActive< T >& x )
+{
+    using std::sqrt;
+    const T value = sqrt( x.value() );
+    return x.tape().record( value, x.index(), 1.0 / ( value + value ) );
+}
+
+template< typename T >
+BasicActive< T > sin( const BasicActive< T >& x )
+{
+    auto [s, c] = detail::sin_cos( x.value() );
+    return x.tape().record( std::move( s ), x.index(), std::move( c ) );
+}
+
+template< typename T >
+BasicActive< T > cos( const BasicActive< T >& x )
+{
+    auto [s, c] = detail::sin_cos( x.value() );
+    return x.tape().record( std::move( c ), x.index(), -s );
+}
+
+} // namespace metal
+
+#endif
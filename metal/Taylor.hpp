@@ -0,0 +1,227 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_TAYLOR_HPP
+#define METAL_TAYLOR_HPP
+
+#include <array>
+#include <cmath>
+#include <utility>
+#include <type_traits>
+
+
+namespace metal
+{
+
+/**
+ * Truncated Taylor series of a function around a point, coefficient k being the k-th derivative
+ * divided by k!. Arithmetic propagates the series, so evaluating an expression with a variable
+ * bound to variable() yields all derivatives up to Order in one evaluation.
+ */
+template< typename T, int Order >
+class Taylor
+{
+public:
+    static_assert( Order >= 0 );
+
+    static constexpr int Size = Order + 1;
+
+    using Coefficients = std::array< T, Size >;
+
+    constexpr Taylor()
+        : coeffs_{}
+    {
+    }
+
+    constexpr Taylor( T value )
+        : coeffs_{}
+    {
+        coeffs_[0] = value;
+    }
+
+    constexpr explicit Taylor( const Coefficients& coeffs )
+        : coeffs_{ coeffs }
+    {
+    }
+
+    /** Series of the independent variable itself, with unit first derivative */
+    static constexpr Taylor variable( T value )
+    {
+        Taylor result{ value };
+        if constexpr ( Order > 0 )
+        {
+            result.coeffs_[1] = T{ 1 };
+        }
+        return result;
+    }
+
+    constexpr const Coefficients& coeffs() const { return coeffs_; }
+    constexpr T value() const { return coeffs_[0]; }
+    constexpr T operator[]( const int k ) const { return coeffs_[k]; }
+
+    /** The k-th derivative, k! times the k-th coefficient */
+    constexpr T deriv( const int k ) const
+    {
+        T factorial{ 1 };
+        for ( int i = 2; i <= k; ++i )
+        {
+            factorial *= i;
+        }
+        return coeffs_[k] * factorial;
+    }
+
+    friend constexpr Taylor operator-( const Taylor& x )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            result.coeffs_[k] = -x.coeffs_[k];
+        }
+        return result;
+    }
+
+    friend constexpr Taylor operator+( const Taylor& x, const Taylor& y )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            result.coeffs_[k] = x.coeffs_[k] + y.coeffs_[k];
+        }
+        return result;
+    }
+
+    friend constexpr Taylor operator-( const Taylor& x, const Taylor& y )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            result.coeffs_[k] = x.coeffs_[k] - y.coeffs_[k];
+        }
+        return result;
+    }
+
+    friend constexpr Taylor operator*( const Taylor& x, const Taylor& y )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            for ( int i = 0; i <= k; ++i )
+            {
+                result.coeffs_[k] += x.coeffs_[i] * y.coeffs_[k - i];
+            }
+        }
+        return result;
+    }
+
+    friend constexpr Taylor operator/( const Taylor& x, const Taylor& y )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            T sum = x.coeffs_[k];
+            for ( int i = 1; i <= k; ++i )
+            {
+                sum -= y.coeffs_[i] * result.coeffs_[k - i];
+            }
+            result.coeffs_[k] = sum / y.coeffs_[0];
+        }
+        return result;
+    }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator+( const Taylor& x, S y )
+    {
+        Taylor result{ x };
+        result.coeffs_[0] += y;
+        return result;
+    }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator+( S x, const Taylor& y ) { return y + x; }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator-( const Taylor& x, S y ) { return x + ( -y ); }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator-( S x, const Taylor& y ) { return -y + x; }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator*( const Taylor& x, S y )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            result.coeffs_[k] = x.coeffs_[k] * y;
+        }
+        return result;
+    }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator*( S x, const Taylor& y ) { return y * x; }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator/( const Taylor& x, S y )
+    {
+        Taylor result;
+        for ( int k = 0; k < Size; ++k )
+        {
+            result.coeffs_[k] = x.coeffs_[k] / y;
+        }
+        return result;
+    }
+
+    template< typename S >
+    requires std::is_arithmetic_v< S >
+    friend constexpr Taylor operator/( S x, const Taylor& y ) { return Taylor{ static_cast< T >( x ) } / y; }
+
+    friend Taylor sqrt( const Taylor& x )
+    {
+        Taylor result{ std::sqrt( x.coeffs_[0] ) };
+        for ( int k = 1; k < Size; ++k )
+        {
+            T sum = x.coeffs_[k];
+            for ( int i = 1; i < k; ++i )
+            {
+                sum -= result.coeffs_[i] * result.coeffs_[k - i];
+            }
+            result.coeffs_[k] = sum / ( 2 * result.coeffs_[0] );
+        }
+        return result;
+    }
+
+    friend Taylor sin( const Taylor& x ) { return sincos( x ).first; }
+    friend Taylor cos( const Taylor& x ) { return sincos( x ).second; }
+
+    /** Sine and cosine are propagated together, each needs the other's coefficients */
+    friend std::pair< Taylor, Taylor > sincos( const Taylor& x )
+    {
+        Taylor s{ std::sin( x.coeffs_[0] ) };
+        Taylor c{ std::cos( x.coeffs_[0] ) };
+        for ( int k = 1; k < Size; ++k )
+        {
+            T ssum{};
+            T csum{};
+            for ( int j = 1; j <= k; ++j )
+            {
+                ssum += j * x.coeffs_[j] * c.coeffs_[k - j];
+                csum += j * x.coeffs_[j] * s.coeffs_[k - j];
+            }
+            s.coeffs_[k] = ssum / k;
+            c.coeffs_[k] = -csum / k;
+        }
+        return { s, c };
+    }
+
+private:
+    Coefficients coeffs_;
+};
+
+} // namespace metal
+
+#endif
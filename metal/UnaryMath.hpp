@@ -5,8 +5,9 @@
 
 #include "UnaryOperator.hpp"
 #include "Common.hpp"
+#include "Constant.hpp"
 #include <cmath>
-#include <fmt/core.h>
+#include <string_view>
 
 
 namespace metal
@@ -18,90 +19,122 @@ namespace detail
 struct NegateOp
 {
     template< typename Input >
-    static constexpr auto eval( Input input )
+    static constexpr auto eval( const Input& input )
     {
-        return -input.eval();
+        return apply( input.eval() );
     }
 
-    template< typename Var, typename Input >
-    static constexpr auto deriv( Input input )
+    template< typename Input >
+    static constexpr auto apply( const Input& input )
     {
-        return -diff< Var >( input );
+        return -input;
     }
 
-    template< typename Input >
-    static constexpr std::string str( Input input )
+    template< typename Input, typename Value, typename Seed >
+    static constexpr auto adjoint( const Input&, const Value&, const Seed& seed )
     {
-        return fmt::format( "(-{0})", input.str() );
+        return -seed;
     }
+
+    template< typename Var, typename Input >
+    static constexpr auto deriv( const Input& input )
+    {
+        return -diff< Var >( input );
+    }
+
+    /** Text of the node, with {0} standing for the text of the input */
+    static constexpr std::string_view Format = "(-{0})";
 };
 
 
 struct SquareOp
 {
     template< typename Input >
-    static constexpr auto eval( Input input )
+    static constexpr auto eval( const Input& input )
     {
-        const auto tmp = input.eval();
-        return tmp * tmp;
+        return apply( input.eval() );
     }
 
-    template< typename Var, typename Input >
-    static constexpr auto deriv( Input input )
+    template< typename Input >
+    static constexpr auto apply( const Input& input )
     {
-        return Constant{ 2 } * input * diff< Var >( input );
+        return input * input;
     }
 
-    template< typename Input >
-    static constexpr std::string str( Input input )
+    template< typename Input, typename Value, typename Seed >
+    static constexpr auto adjoint( const Input& input, const Value&, const Seed& seed )
     {
-        return fmt::format( "{0}^2", input.str() );
+        return seed * ( input + input );
     }
+
+    template< typename Var, typename Input >
+    static constexpr auto deriv( const Input& input )
+    {
+        return Constant{ 2 } * input * diff< Var >( input );
+    }
+
+    static constexpr std::string_view Format = "{0}^2";
 };
 
 
 struct CubeOp
 {
     template< typename Input >
-    static constexpr auto eval( Input input )
+    static constexpr auto eval( const Input& input )
     {
-        const auto tmp = input.eval();
-        return tmp * tmp * tmp;
+        return apply( input.eval() );
     }
 
-    template< typename Var, typename Input >
-    static constexpr auto deriv( Input input )
+    template< typename Input >
+    static constexpr auto apply( const Input& input )
     {
-        return Constant{ 3 } * square( input ) * diff< Var >( input );
+        return input * input * input;
     }
 
-    template< typename Input >
-    static constexpr std::string str( Input input )
+    template< typename Input, typename Value, typename Seed >
+    static constexpr auto adjoint( const Input& input, const Value&, const Seed& seed )
     {
-        return fmt::format( "{0}^3", input.str() );
+        return seed * 3 * input * input;
     }
+
+    template< typename Var, typename Input >
+    static constexpr auto deriv( const Input& input )
+    {
+        return Constant{ 3 } * square( input ) * diff< Var >( input );
+    }
+
+    static constexpr std::string_view Format = "{0}^3";
 };
 
 
 struct SquareRootOp
 {
     template< typename Input >
-    static constexpr auto eval( Input input )
+    static constexpr auto eval( const Input& input )
     {
-        return std::sqrt( input.eval() );
+        return apply( input.eval() );
     }
 
-    template< typename Var, typename Input >
-    static constexpr auto deriv( Input input )
+    template< typename Input >
+    static constexpr auto apply( const Input& input )
     {
-        return Constant{ 0.5 } / sqrt( input ) * diff< Var >( input );
+        using std::sqrt;
+        return sqrt( input );
     }
 
-    template< typename Input >
-    static constexpr std::string str( Input input )
+    template< typename Input, typename Value, typename Seed >
+    static constexpr auto adjoint( const Input&, const Value& value, const Seed& seed )
+    {
+        return seed / ( value + value );
+    }
+
+    template< typename Var, typename Input >
+    static constexpr auto deriv( const Input& input )
     {
-        return fmt::format( "sqrt({0})", input.str() );
+        return Constant{ 0.5 } / sqrt( input ) * diff< Var >( input );
     }
+
+    static constexpr std::string_view Format = "sqrt({0})";
 };
 
 } // detail
@@ -140,43 +173,114 @@ template< typename Input >
 SquareRoot( Input ) -> SquareRoot< Input >;
 
 
-template< typename Input >
-constexpr auto operator-( Input input )
+template< detail::Expression Input >
+constexpr auto operator-( const Input& input )
 {
     return simplify( Negate< Input >{ input } );
 }
 
-template< typename Input >
-constexpr auto square( Input input )
+template< detail::Expression Input >
+constexpr auto square( const Input& input )
 {
-    return simplify( Square{ input } );
+    return simplify( Square< Input >{ input } );
 }
 
-template< typename Input >
-constexpr auto cube( Input input )
+template< detail::Expression Input >
+constexpr auto cube( const Input& input )
 {
-    return simplify( Cube{ input } );
+    return simplify( Cube< Input >{ input } );
+}
+
+template< detail::Expression Input >
+constexpr auto sqrt( const Input& input )
+{
+    return simplify( SquareRoot< Input >{ input } );
 }
 
-// template <typename T>
-// concept HasFunc1 = 
-//   requires(T t) {
-//       { t.eval() };
-//   };
 
 template< typename Input >
-constexpr auto sqrt( Input input )
+constexpr auto simplify( const Negate< Negate< Input > >& input )
+{
+    return input.input().input();
+}
+
+constexpr auto simplify( const Negate< Zero >& )
+{
+    return Zero{};
+}
+
+template< detail::Number Input >
+constexpr auto simplify( const Negate< Input >& input )
+{
+    return Constant{ -input.input().eval() };
+}
+
+constexpr auto simplify( const Square< Zero >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const Square< One >& )
 {
-    return simplify( SquareRoot{ input } );
+    return One{};
 }
 
+template< detail::Number Input >
+constexpr auto simplify( const Square< Input >& input )
+{
+    return Constant{ detail::SquareOp::apply( input.input().eval() ) };
+}
 
 template< typename Input >
-constexpr auto simplify( Negate< Negate< Input > > input )
+constexpr auto simplify( const Square< Negate< Input > >& input )
+{
+    return square( input.input().input() );
+}
+
+template< typename Input >
+constexpr auto simplify( const Square< SquareRoot< Input > >& input )
 {
     return input.input().input();
 }
 
+constexpr auto simplify( const Cube< Zero >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const Cube< One >& )
+{
+    return One{};
+}
+
+template< detail::Number Input >
+constexpr auto simplify( const Cube< Input >& input )
+{
+    return Constant{ detail::CubeOp::apply( input.input().eval() ) };
+}
+
+template< typename Input >
+constexpr auto simplify( const Cube< Negate< Input > >& input )
+{
+    return -cube( input.input().input() );
+}
+
+constexpr auto simplify( const SquareRoot< Zero >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const SquareRoot< One >& )
+{
+    return One{};
+}
+
+template< detail::Number Input >
+constexpr auto simplify( const SquareRoot< Input >& input )
+{
+    return Constant{ detail::SquareRootOp::apply( input.input().eval() ) };
+}
+
 } // metal
 
 #endif
@@ -3,35 +3,46 @@
 #ifndef METAL_UNARY_MATH_OPERATOR_HPP
 #define METAL_UNARY_MATH_OPERATOR_HPP
 
+#include "Common.hpp"
 #include <tuple>
+#include <string>
 
 
 template< typename Input, typename Operator >
 class UnaryOperator
 {
 public:
-    constexpr UnaryOperator( Input input )
+    using InputType = Input;
+    using OperatorType = Operator;
+
+    constexpr UnaryOperator( const Input& input )
         : input_{ input }
     {
     }
 
-    constexpr auto input() const { return input_; }
+    constexpr const Input& input() const { return input_; }
 
     constexpr auto eval() const
     {
         return Operator::eval( input_ );
     }
 
+    template< typename Env >
+    constexpr auto eval( const Env& env ) const
+    {
+        return Operator::apply( input_.eval( env ) );
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
         return Operator::template deriv< Var >( input_ );
     }
 
-    std::string str() const { return Operator::str( input_ ); }
+    std::string str() const { return metal::detail::to_string( *this ); }
 
 private:
-    Input input_;
+    [[no_unique_address]] Input input_;
 };
 
 #endif
@@ -5,10 +5,14 @@
 
 #include "UnaryOperator.hpp"
 #include "Common.hpp"
+#include "Constant.hpp"
+#include "UnaryMath.hpp"
+#include "SinCos.hpp"
 #include <tuple>
+#include <utility>
 #include <cmath>
 #include <string>
-#include <fmt/core.h>
+#include <string_view>
 
 
 namespace metal
@@ -20,43 +24,93 @@ namespace detail
 struct SinOp
 {
     template< typename Input >
-    static constexpr auto eval( Input input )
+    static constexpr auto eval( const Input& input )
     {
-        return std::sin( input.eval() );
+        return apply( input.eval() );
     }
 
-    template< typename Var, typename Input >
-    static constexpr auto deriv( Input input )
+    template< typename Input >
+    static constexpr auto apply( const Input& input )
     {
-        return cos( input ) * diff< Var >( input );
+        using std::sin;
+        return sin( input );
     }
 
+    /** Value together with the derivative, from a single fused sine and cosine */
     template< typename Input >
-    static constexpr std::string str( Input input )
+    static constexpr auto apply_with_deriv( const Input& input )
     {
-        return fmt::format( "sin({0})", input.str() );
+        return sin_cos( input );
     }
+
+    /** Value together with the cosine of the same input */
+    template< typename Input >
+    static constexpr auto apply_with_sibling( const Input& input )
+    {
+        return sin_cos( input );
+    }
+
+    template< typename Input, typename Value, typename Seed >
+    static constexpr auto adjoint( const Input& input, const Value&, const Seed& seed )
+    {
+        using std::cos;
+        return seed * cos( input );
+    }
+
+    template< typename Var, typename Input >
+    static constexpr auto deriv( const Input& input )
+    {
+        return cos( input ) * diff< Var >( input );
+    }
+
+    /** Text of the node, with {0} standing for the text of the input */
+    static constexpr std::string_view Format = "sin({0})";
 };
 
 struct CosOp
 {
     template< typename Input >
-    static constexpr auto eval( Input input )
+    static constexpr auto eval( const Input& input )
     {
-        return std::cos( input.eval() );
+        return apply( input.eval() );
     }
 
-    template< typename Var, typename Input >
-    static constexpr auto deriv( Input input )
+    template< typename Input >
+    static constexpr auto apply( const Input& input )
     {
-        return -sin( input ) * diff< Var >( input );
+        using std::cos;
+        return cos( input );
+    }
+
+    template< typename Input >
+    static constexpr auto apply_with_deriv( const Input& input )
+    {
+        const auto [s, c] = sin_cos( input );
+        return std::pair{ c, -s };
     }
 
+    /** Value together with the sine of the same input */
     template< typename Input >
-    static constexpr std::string str( Input input )
+    static constexpr auto apply_with_sibling( const Input& input )
+    {
+        const auto [s, c] = sin_cos( input );
+        return std::pair{ c, s };
+    }
+
+    template< typename Input, typename Value, typename Seed >
+    static constexpr auto adjoint( const Input& input, const Value&, const Seed& seed )
+    {
+        using std::sin;
+        return -seed * sin( input );
+    }
+
+    template< typename Var, typename Input >
+    static constexpr auto deriv( const Input& input )
     {
-        return fmt::format( "cos({0})", input.str() );
+        return -sin( input ) * diff< Var >( input );
     }
+
+    static constexpr std::string_view Format = "cos({0})";
 };
 
 } // detail
@@ -79,16 +133,69 @@ template< typename Input >
 Cos( Input ) -> Cos< Input >;
 
 
+namespace detail
+{
+
+template< typename Input >
+struct Sibling< Sin< Input > >
+{
+    using type = Cos< Input >;
+};
+
+template< typename Input >
+struct Sibling< Cos< Input > >
+{
+    using type = Sin< Input >;
+};
+
+} // detail
+
+
+template< detail::Expression Input >
+constexpr auto sin( const Input& input )
+{
+    return simplify( Sin< Input >{ input } );
+}
+
+template< detail::Expression Input >
+constexpr auto cos( const Input& input )
+{
+    return simplify( Cos< Input >{ input } );
+}
+
+
+constexpr auto simplify( const Sin< Zero >& )
+{
+    return Zero{};
+}
+
+constexpr auto simplify( const Cos< Zero >& )
+{
+    return One{};
+}
+
+template< detail::Number Input >
+constexpr auto simplify( const Sin< Input >& input )
+{
+    return Constant{ detail::SinOp::apply( input.input().eval() ) };
+}
+
+template< detail::Number Input >
+constexpr auto simplify( const Cos< Input >& input )
+{
+    return Constant{ detail::CosOp::apply( input.input().eval() ) };
+}
+
 template< typename Input >
-constexpr auto sin( Input input )
+constexpr auto simplify( const Sin< Negate< Input > >& input )
 {
-    return simplify( Sin{ input } );
+    return -sin( input.input().input() );
 }
 
 template< typename Input >
-constexpr auto cos( Input input )
+constexpr auto simplify( const Cos< Negate< Input > >& input )
 {
-    return simplify( Cos{ input } );
+    return cos( input.input().input() );
 }
 
 } // metal
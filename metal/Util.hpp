@@ -1,5 +1,8 @@
 /** Copyright Gabor Varga 2023 */
 
+#ifndef METAL_UTIL_HPP
+#define METAL_UTIL_HPP
+
 #include <string>
 
 
@@ -16,3 +19,5 @@ void check( bool condition, Params&&... params )
 }
 
 }
+
+#endif
@@ -28,19 +28,72 @@ struct StringLiteral
     char value[N];
 };
 
-// template< size_t N1, size_t N2 >
-// constexpr bool operator==( const StringLiteral< N1 >& left, const StringLiteral< N1 >& right )
-// {
-//     if constexpr ( N1 != N2 )
-//     {
-//         return false;
-//     }
-//     else
-//     {
-//         return left == right;
-//     }
-// }
+template< size_t N1, size_t N2 >
+constexpr bool operator==( const StringLiteral< N1 >& left, const StringLiteral< N2 >& right )
+{
+    if constexpr ( N1 != N2 )
+    {
+        return false;
+    }
+    else
+    {
+        return std::equal( left.value, left.value + N1, right.value );
+    }
+}
+
+}
+
+
+/** Value bound to the variable with the given name */
+template< detail::StringLiteral Name_, typename Value_ >
+struct Binding
+{
+    static constexpr detail::StringLiteral Name = Name_;
+    using Value = Value_;
+
+    Value value;
+};
+
+/** Values of variables looked up by name during evaluation, instead of the values they were built with */
+template< typename... Bindings_ >
+class Bindings
+{
+public:
+    constexpr Bindings( Bindings_... bindings )
+        : bindings_{ bindings... }
+    {
+    }
+
+    template< detail::StringLiteral Name >
+    static constexpr bool has = ( ( Bindings_::Name == Name ) || ... );
+
+    template< detail::StringLiteral Name >
+    constexpr const auto& get() const
+    {
+        return std::get< index< Name >() >( bindings_ ).value;
+    }
+
+private:
+    template< detail::StringLiteral Name >
+    static constexpr size_t index()
+    {
+        constexpr bool match[] = { ( Bindings_::Name == Name )... };
+        size_t i = 0;
+        while ( !match[i] )
+        {
+            ++i;
+        }
+        return i;
+    }
+
+    std::tuple< Bindings_... > bindings_;
+};
 
+/** Bind a value to the variable with the given name */
+template< detail::StringLiteral Name, typename Value >
+constexpr auto bind( Value value )
+{
+    return Binding< Name, Value >{ value };
 }
 
 
@@ -50,6 +103,11 @@ class Variable
 public:
     static constexpr detail::StringLiteral Name = Name_;
 
+    Variable()
+        : value_{}
+    {
+    }
+
     explicit Variable( Value value )
         : value_{ value }
     {
@@ -57,6 +115,19 @@ public:
 
     constexpr auto eval() const { return value_; }
 
+    template< typename Env >
+    constexpr auto eval( const Env& env ) const
+    {
+        if constexpr ( Env::template has< Name > )
+        {
+            return env.template get< Name >();
+        }
+        else
+        {
+            return value_;
+        }
+    }
+
     template< typename Var >
     constexpr auto deriv() const
     {
@@ -72,6 +143,12 @@ public:
 
     std::string str() const { return Name.value; }
 
+    template< typename Out >
+    static constexpr Out format_to( Out out )
+    {
+        return std::copy_n( Name.value, Name.Size - 1, out );
+    }
+
 private:
     Value value_;
 };
@@ -79,6 +156,17 @@ private:
 template< detail::StringLiteral Name >
 using Double = Variable< Name, double >;
 
+
+namespace detail
+{
+
+template< StringLiteral Name, typename Value >
+struct IsNode< Variable< Name, Value > > : std::true_type
+{
+};
+
+} // detail
+
 #define DOUBLE( name, value ) metal::Double< #name > name{ value };
 
 } // metal
@@ -0,0 +1,70 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Allocations.hpp"
+#include "metal/Arena.hpp"
+
+#include <new>
+#include <cstdlib>
+
+
+namespace
+{
+
+thread_local size_t allocations = 0;
+
+} // namespace
+
+
+// Counting replacement of the global allocation functions, linked into the tests and the benchmarks.
+// The sanitizers replace every form, so each reachable form is replaced here instead of relying on
+// the default forwarding.
+void* operator new( size_t bytes, const std::nothrow_t& ) noexcept
+{
+    ++allocations;
+    return std::malloc( bytes == 0 ? 1 : bytes );
+}
+
+void* operator new( size_t bytes )
+{
+    if ( void* data = operator new( bytes, std::nothrow ) )
+    {
+        return data;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new[]( size_t bytes, const std::nothrow_t& ) noexcept
+{
+    return operator new( bytes, std::nothrow );
+}
+
+void* operator new[]( size_t bytes )
+{
+    return operator new( bytes );
+}
+
+void operator delete( void* data ) noexcept
+{
+    std::free( data );
+}
+
+void operator delete( void* data, size_t ) noexcept
+{
+    std::free( data );
+}
+
+void operator delete[]( void* data ) noexcept
+{
+    std::free( data );
+}
+
+void operator delete[]( void* data, size_t ) noexcept
+{
+    std::free( data );
+}
+
+
+size_t heap_allocations()
+{
+    return ::allocations + metal::storage_allocations();
+}
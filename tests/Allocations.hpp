@@ -0,0 +1,12 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_TESTS_ALLOCATIONS_HPP
+#define METAL_TESTS_ALLOCATIONS_HPP
+
+#include <cstddef>
+
+
+/** Heap allocations of the calling thread so far, through operator new and the metal allocator */
+size_t heap_allocations();
+
+#endif
@@ -0,0 +1,142 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Allocations.hpp"
+#include "metal/Arena.hpp"
+#include "metal/ScalarGradient.hpp"
+#include "metal/Dual.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+
+
+TEST_CASE( "Test arena allocation" )
+{
+    SECTION( "Test allocations are aligned and reset keeps the blocks" )
+    {
+        metal::Arena arena{ 256 };
+        const auto before = metal::storage_allocations();
+
+        auto* a = arena.allocate( 10 );
+        auto* b = arena.allocate( 8, 64 );
+        REQUIRE( reinterpret_cast< uintptr_t >( b ) % 64 == 0 );
+        REQUIRE( a != b );
+        arena.allocate( 1000 );
+        REQUIRE( metal::storage_allocations() == before + 2 );
+
+        const auto capacity = arena.capacity();
+        arena.reset();
+        REQUIRE( arena.used() == 0 );
+        arena.allocate( 10 );
+        arena.allocate( 1000 );
+        REQUIRE( arena.capacity() == capacity );
+        REQUIRE( metal::storage_allocations() == before + 2 );
+    }
+
+    SECTION( "Test scopes nest and restore the previous arena" )
+    {
+        REQUIRE( metal::current_arena() == nullptr );
+        metal::Arena outer;
+        metal::Arena inner;
+        {
+            const metal::ArenaScope outer_scope{ outer };
+            {
+                const metal::ArenaScope inner_scope{ inner };
+                REQUIRE( metal::current_arena() == &inner );
+            }
+            REQUIRE( metal::current_arena() == &outer );
+        }
+        REQUIRE( metal::current_arena() == nullptr );
+    }
+}
+
+
+namespace
+{
+
+/** Evaluate a function of four Duals twice in an arena scope, the second time without heap allocations */
+template< typename Gradient >
+void check_arena_evaluation()
+{
+    using Dual = metal::Dual< double, Gradient >;
+
+    const metal::Parameter p[4];
+    const Dual x[4] = { { 1.0, Gradient{ { p[0] }, { 1.0 } } }, { 2.0, Gradient{ { p[1] }, { 1.0 } } },
+        { 3.0, Gradient{ { p[2] }, { 1.0 } } }, { 4.0, Gradient{ { p[3] }, { 1.0 } } } };
+
+    metal::Arena arena;
+    const auto evaluate = [&]()
+    {
+        const metal::ArenaScope scope{ arena };
+        const auto f = x[0] * x[1] + sin( x[2] ) * x[3] - x[0] / x[3];
+        REQUIRE( !f.deriv().parameters().is_inline() );
+        return std::pair{ f.value(), f.deriv().at( p[2] ) };
+    };
+
+    // The first evaluation grows the arena to its working size
+    evaluate();
+    const auto before = heap_allocations();
+    const auto [value, deriv] = evaluate();
+    REQUIRE( heap_allocations() == before );
+
+    REQUIRE( value == 2.0 + std::sin( 3.0 ) * 4.0 - 0.25 );
+    REQUIRE( deriv == std::cos( 3.0 ) * 4.0 );
+}
+
+} // namespace
+
+
+TEST_CASE( "Test gradient arithmetic without heap allocations" )
+{
+    SECTION( "Test default dynamic gradient" )
+    {
+        check_arena_evaluation< metal::Gradient< double, -1 > >();
+    }
+
+    SECTION( "Test dynamic gradient with inline storage" )
+    {
+        check_arena_evaluation< metal::Gradient< double, -1, 2 > >();
+    }
+}
+
+
+TEST_CASE( "Test results outlive the arena scope" )
+{
+    using Gradient = metal::Gradient< double, -1, 1 >;
+    using Dual = metal::Dual< double, Gradient >;
+
+    const metal::Parameter p[3];
+    const Dual x[3] = { { 1.0, Gradient{ { p[0] }, { 1.0 } } }, { 2.0, Gradient{ { p[1] }, { 1.0 } } },
+        { 3.0, Gradient{ { p[2] }, { 1.0 } } } };
+
+    metal::Arena arena;
+    Dual result;
+    Gradient grown{ { p[0] }, { 2.0 } };
+    REQUIRE( result.deriv().parameters().arena() == nullptr );
+    {
+        const metal::ArenaScope scope{ arena };
+        const auto f = x[0] * x[1] * x[2];
+        REQUIRE( f.deriv().parameters().arena() == &arena );
+
+        // Assigned to a gradient from outside the scope the result is copied to the heap
+        result = f;
+        grown = grown + x[1].deriv() + x[2].deriv();
+    }
+    REQUIRE( result.deriv().parameters().arena() == nullptr );
+    REQUIRE( !grown.parameters().is_inline() );
+
+    // Overwrite the arena memory of the first scope
+    {
+        const metal::ArenaScope scope{ arena };
+        const auto f = x[2] * x[1] * x[0] + x[0];
+        REQUIRE( f.value() == 7.0 );
+    }
+
+    REQUIRE( result.value() == 6.0 );
+    REQUIRE( result.deriv().at( p[0] ) == 6.0 );
+    REQUIRE( result.deriv().at( p[1] ) == 3.0 );
+    REQUIRE( result.deriv().at( p[2] ) == 2.0 );
+    REQUIRE( grown.at( p[0] ) == 2.0 );
+    REQUIRE( grown.at( p[1] ) == 1.0 );
+    REQUIRE( grown.at( p[2] ) == 1.0 );
+}
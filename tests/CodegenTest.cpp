@@ -0,0 +1,34 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Model.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+
+/** Function generated from the test model at build time */
+void model( const double* inputs, double* outputs );
+
+
+TEST_CASE( "Test generated code matches the program" )
+{
+    const auto program = model_program();
+    const auto& outputs = program.outputs();
+    REQUIRE( outputs.size() == 5 );
+
+    const std::vector< std::vector< double > > points = { program.values(), { 1.1, -0.4 }, { 2.5, 3.75 } };
+    for ( const auto& inputs : points )
+    {
+        std::vector< double > generated( outputs.size() );
+        model( inputs.data(), generated.data() );
+
+        for ( size_t k = 0; k < outputs.size(); ++k )
+        {
+            // Every output in turn as the result of eval(), contractions may change the last bits
+            const metal::Program single{ program.instructions(), program.constants(), program.variables(),
+                program.values(), outputs[k] };
+            CAPTURE( k, inputs[0], inputs[1] );
+            REQUIRE_THAT( generated[k], Catch::Matchers::WithinRel( single.eval( inputs ), 1e-14 ) );
+        }
+    }
+}
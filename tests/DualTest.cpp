@@ -1,8 +1,10 @@
 /** Copyright Gabor Varga 2023 */
 
 #include "metal/Dual.hpp"
+#include "metal/Directions.hpp"
 #include "Mock.hpp"
 
+#include <cmath>
 #include <catch2/catch_test_macros.hpp>
 
 // Set up mock objects
@@ -124,3 +126,45 @@ TEST_CASE( "Test number of function calls with different constructor arguments"
         test_function_calls( perfect_binary_op_move, perfect_binary_op_move );
     }
 }
+
+
+TEST_CASE( "Test dual number arithmetic" )
+{
+    using Dual = metal::Dual< double, double >;
+    const Dual x{ 2.0, 1.0 };
+    const Dual y{ 3.0, 0.0 };
+
+    REQUIRE( ( x - y ).value() == -1.0 );
+    REQUIRE( ( x - y ).deriv() == 1.0 );
+    REQUIRE( ( x * y ).deriv() == 3.0 );
+    REQUIRE( ( y / x ).deriv() == -0.75 );
+    REQUIRE( ( -x ).deriv() == -1.0 );
+    REQUIRE( ( 2.0 * x + 1.0 ).value() == 5.0 );
+    REQUIRE( ( 1.0 / x ).deriv() == -0.25 );
+    REQUIRE( metal::square( x ).deriv() == 4.0 );
+    REQUIRE( metal::cube( x ).deriv() == 12.0 );
+    REQUIRE( sqrt( Dual{ 4.0, 1.0 } ).deriv() == 0.25 );
+    REQUIRE( sin( x ).deriv() == std::cos( 2.0 ) );
+    REQUIRE( cos( x ).deriv() == -std::sin( 2.0 ) );
+}
+
+
+TEST_CASE( "Test dual number with multiple directions" )
+{
+    constexpr int N = 5;
+    using Directions = metal::Directions< double, N >;
+    using Dual = metal::Dual< double, Directions >;
+
+    Dual x[N] = { metal::seed< Directions >( 1.0, 0 ), metal::seed< Directions >( 2.0, 1 ),
+        metal::seed< Directions >( 3.0, 2 ), metal::seed< Directions >( 4.0, 3 ), metal::seed< Directions >( 5.0, 4 ) };
+
+    // f = x0 * x1 + sin( x2 ) / x3 - sqrt( x4 )
+    const auto f = x[0] * x[1] + sin( x[2] ) / x[3] - sqrt( x[4] );
+
+    REQUIRE( f.value() == 1.0 * 2.0 + std::sin( 3.0 ) / 4.0 - std::sqrt( 5.0 ) );
+    REQUIRE( f.deriv()[0] == 2.0 );
+    REQUIRE( f.deriv()[1] == 1.0 );
+    REQUIRE( f.deriv()[2] == std::cos( 3.0 ) / 4.0 );
+    REQUIRE( f.deriv()[3] == -std::sin( 3.0 ) / 16.0 );
+    REQUIRE( f.deriv()[4] == -0.5 / std::sqrt( 5.0 ) );
+}
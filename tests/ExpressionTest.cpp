@@ -1,9 +1,11 @@
 /** Copyright Gabor Varga 2023 */
 
 #include "metal/Core.hpp"
+#include <limits>
 #include <iostream>
+#include <type_traits>
 #include <catch2/catch_test_macros.hpp>
-// #include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
 
 
 // double sqrt( double x )
@@ -69,34 +71,499 @@ TEST_CASE( "Test basic expression" )
 
         const auto d4 = diff( d3, x );
         fmt::println( "{0} = {1}", d4.str(), d4.eval() );
+    }
+}
+
+
+TEST_CASE( "Test simplification rules" )
+{
+    using metal::Constant;
+    using metal::One;
+    using metal::Pi;
+    using metal::Zero;
+
+    DOUBLE( x, 2.0 );
+    DOUBLE( y, 3.0 );
+    using X = metal::Double< "x" >;
+    using Y = metal::Double< "y" >;
+
+    SECTION( "Test constant folding" )
+    {
+        const auto a = Constant{ 2 } * Constant{ 3 };
+        STATIC_REQUIRE( std::is_same_v< decltype( a ), const Constant< int > > );
+        REQUIRE( a.eval() == 6 );
+
+        const auto b = -Constant{ 2.5 };
+        STATIC_REQUIRE( std::is_same_v< decltype( b ), const Constant< double > > );
+        REQUIRE( b.eval() == -2.5 );
+
+        const auto c = metal::TwoPi{} / Pi{} + One{};
+        REQUIRE( c.eval() == 3.0 );
+        REQUIRE( sqrt( Constant{ 4.0 } ).eval() == 2.0 );
+        STATIC_REQUIRE( std::is_same_v< decltype( sin( Zero{} ) ), Zero > );
+        STATIC_REQUIRE( std::is_same_v< decltype( cos( Zero{} ) ), One > );
+        STATIC_REQUIRE( std::is_same_v< decltype( Zero{} * One{} ), Zero > );
+        STATIC_REQUIRE( std::is_same_v< decltype( Zero{} / One{} ), Zero > );
+        STATIC_REQUIRE( std::is_same_v< decltype( square( One{} ) ), One > );
+    }
+
+    SECTION( "Test coefficient merging" )
+    {
+        const auto a = Constant{ 2.0 } * ( Constant{ 3.0 } * x );
+        STATIC_REQUIRE( std::is_same_v< decltype( a ), const metal::Multiply< Constant< double >, X > > );
+        REQUIRE( a.left().eval() == 6.0 );
+
+        const auto b = ( x * 3.0 ) * 2.0;
+        STATIC_REQUIRE( std::is_same_v< decltype( b ), const metal::Multiply< Constant< double >, X > > );
+        REQUIRE( b.eval() == 12.0 );
+    }
+
+    SECTION( "Test repeated operands" )
+    {
+        STATIC_REQUIRE( std::is_same_v< decltype( x * x ), metal::Square< X > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( sqrt( x ) * sqrt( x ) ), X > );
+        STATIC_REQUIRE( std::is_same_v< decltype( square( sqrt( x ) ) ), X > );
+        STATIC_REQUIRE( std::is_same_v< decltype( sin( x ) - sin( x ) ), Zero > );
+        STATIC_REQUIRE( std::is_same_v< decltype( ( x + y ) / ( x + y ) ), One > );
+
+        // Operands with runtime constants may differ, so they are kept
+        const auto a = ( x + 1.0 ) * ( x + 2.0 );
+        REQUIRE( a.eval() == 12.0 );
+    }
+
+    SECTION( "Test negate propagation" )
+    {
+        STATIC_REQUIRE( std::is_same_v< decltype( -x * y ), metal::Negate< metal::Multiply< X, Y > > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( x / -y ), metal::Negate< metal::Divide< X, Y > > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( -x * -y ), metal::Multiply< X, Y > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( -x * -x ), metal::Square< X > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( x - -y ), metal::Add< X, Y > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( x + -y ), metal::Subtract< X, Y > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( square( -x ) ), metal::Square< X > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( cos( -x ) ), metal::Cos< X > > );
+
+        const auto a = Constant{ 2.0 } * -x;
+        STATIC_REQUIRE( std::is_same_v< decltype( a ), const metal::Multiply< Constant< double >, X > > );
+        REQUIRE( a.eval() == -4.0 );
+        REQUIRE( ( -x / 4.0 ).eval() == -0.5 );
+    }
+
+    SECTION( "Test derivatives are smaller" )
+    {
+        const auto d2 = diff( diff( sin( x ), x ), x );
+        STATIC_REQUIRE( std::is_same_v< decltype( d2 ), const metal::Negate< metal::Sin< X > > > );
+
+        STATIC_REQUIRE( std::is_same_v< decltype( square( square( x ) ) ), metal::Square< metal::Square< X > > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( sin( sin( x ) ) ), metal::Sin< metal::Sin< X > > > );
+
+        const auto d = diff( Constant{ 3.0 } * square( x ), x );
+        STATIC_REQUIRE( std::is_same_v< decltype( d ), const metal::Multiply< Constant< double >, X > > );
+        REQUIRE( d.eval() == 12.0 );
+    }
+}
+
+
+TEST_CASE( "Test late bound variables" )
+{
+    SECTION( "Test evaluation with bindings" )
+    {
+        const metal::Double< "sma" > sma;
+        const metal::Double< "gm" > gm;
+
+        const auto per = foo( sma, gm );
+        const auto per_diff_sma = diff( per, sma );
+        const auto per_diff_gm = diff( per, gm );
+
+        const double eps = 1e-3;
+        const metal::Bindings a{ metal::bind< "sma" >( 6628.14 ), metal::bind< "gm" >( 398600.44 ) };
+        const metal::Bindings a1{ metal::bind< "sma" >( 6628.14 + eps ), metal::bind< "gm" >( 398600.44 ) };
+        const metal::Bindings a2{ metal::bind< "gm" >( 398600.44 + eps ), metal::bind< "sma" >( 6628.14 ) };
+        const auto y0 = per.eval( a );
+        const auto y1 = per.eval( a1 );
+        const auto y2 = per.eval( a2 );
+
+        REQUIRE_THAT( y0, Catch::Matchers::WithinRel( foo( 6628.14, 398600.44 ), 1e-15 ) );
+        REQUIRE_THAT( per_diff_sma.eval( a ), Catch::Matchers::WithinRel( ( y1 - y0 ) / eps, 1e-6 ) );
+        REQUIRE_THAT( per_diff_gm.eval( a ), Catch::Matchers::WithinRel( ( y2 - y0 ) / eps, 1e-6 ) );
+
+        const auto g = metal::gradient( per, a );
+        REQUIRE_THAT( g.at( sma ), Catch::Matchers::WithinRel( per_diff_sma.eval( a ), 1e-14 ) );
+        REQUIRE_THAT( metal::cse( per_diff_gm ).eval( a ), Catch::Matchers::WithinULP( per_diff_gm.eval( a ), 0 ) );
+    }
+
+    SECTION( "Test unbound variables keep their value" )
+    {
+        DOUBLE( x, 2.0 );
+        DOUBLE( y, 3.0 );
+
+        const auto z = x * y;
+        REQUIRE( z.eval( metal::Bindings{ metal::bind< "y" >( 5.0 ) } ) == 10.0 );
+        REQUIRE( z.eval( metal::Bindings{} ) == z.eval() );
+    }
+}
+
+
+TEST_CASE( "Test common subexpression elimination" )
+{
+    SECTION( "Test repeated subtrees are evaluated once" )
+    {
+        DOUBLE( x, 1.0 );
+        DOUBLE( y, 2.0 );
+
+        const auto z = foo( x, y );
+        const auto dzdx = diff( z, x );
+        const auto d2zdx2 = diff( dzdx, x );
+        const auto e = metal::cse( d2zdx2 );
+
+        REQUIRE( e.shared() > 0 );
+        REQUIRE( e.str() == d2zdx2.str() );
+        REQUIRE_THAT( e.eval(), Catch::Matchers::WithinULP( d2zdx2.eval(), 0 ) );
+    }
+
+    SECTION( "Test subtrees with different constants are not shared" )
+    {
+        DOUBLE( x, 1.0 );
+
+        const auto e = metal::cse( ( x + 1.0 ) * ( x + 2.0 ) );
+        REQUIRE( e.shared() == 0 );
+        REQUIRE_THAT( e.eval(), Catch::Matchers::WithinULP( 6.0, 0 ) );
+
+        const auto f = metal::cse( ( x + 1.0 ) * ( x + 1.0 ) );
+        REQUIRE( f.shared() == 1 );
+        REQUIRE_THAT( f.eval(), Catch::Matchers::WithinULP( 4.0, 0 ) );
+    }
+
+    SECTION( "Test sine and cosine of the same argument are fused" )
+    {
+        DOUBLE( x, 0.7 );
+        DOUBLE( y, 1.3 );
+
+        const auto z = sin( x * y ) * cos( x * y ) + cos( x );
+        const auto e = metal::cse( z );
+        REQUIRE( e.fused() == 2 );
+        REQUIRE_THAT( e.eval(), Catch::Matchers::WithinULP( z.eval(), 0 ) );
+
+        const auto f = metal::cse( sin( x + 1.0 ) * cos( x + 2.0 ) );
+        REQUIRE( f.fused() == 0 );
+        REQUIRE_THAT( f.eval(), Catch::Matchers::WithinULP( sin( 1.7 ) * cos( 2.7 ), 0 ) );
+
+        const metal::Variable< "u", long double > u{ 0.5L };
+        const auto g = metal::gradient( sin( u ) * cos( u ) );
+        REQUIRE( g.value() == std::sin( 0.5L ) * std::cos( 0.5L ) );
+        REQUIRE( std::abs( g.at( u ) - std::cos( 1.0L ) ) < 1e-18L );
+    }
+}
+
+
+TEST_CASE( "Test reverse mode gradient" )
+{
+    SECTION( "Test gradient matches symbolic derivatives" )
+    {
+        DOUBLE( x, 1.5 );
+        DOUBLE( y, 2.0 );
+
+        const auto z = foo( x, y ) + sin( x ) * cos( y ) - square( y ) / x;
+        const auto g = metal::gradient( z );
+
+        REQUIRE( g.Size == 2 );
+        REQUIRE_THAT( g.value(), Catch::Matchers::WithinRel( z.eval(), 1e-15 ) );
+        REQUIRE_THAT( g.at( x ), Catch::Matchers::WithinRel( diff( z, x ).eval(), 1e-14 ) );
+        REQUIRE_THAT( g.at< "y" >(), Catch::Matchers::WithinRel( diff( z, y ).eval(), 1e-14 ) );
+    }
+
+    SECTION( "Test variables with different name lengths" )
+    {
+        DOUBLE( sma, 7000.0 );
+        DOUBLE( gm, 398600.0 );
+
+        const auto per = metal::TwoPi{} * sqrt( cube( sma ) / gm );
+        const auto g = metal::gradient( per );
+
+        REQUIRE_THAT( g.at( sma ), Catch::Matchers::WithinRel( diff( per, sma ).eval(), 1e-14 ) );
+        REQUIRE_THAT( g.at( gm ), Catch::Matchers::WithinRel( diff( per, gm ).eval(), 1e-14 ) );
+    }
+}
+
+
+TEST_CASE( "Test fused value and gradient evaluation" )
+{
+    SECTION( "Test value and requested partials" )
+    {
+        DOUBLE( x, 1.5 );
+        DOUBLE( y, 2.0 );
+
+        const auto z = foo( x, y ) + sin( x ) * cos( y );
+        const auto result = metal::eval_with_gradient( z, x, y );
+
+        REQUIRE( result.Size == 2 );
+        REQUIRE_THAT( result.value(), Catch::Matchers::WithinULP( z.eval(), 0 ) );
+        REQUIRE_THAT( result.at( x ), Catch::Matchers::WithinRel( diff( z, x ).eval(), 1e-14 ) );
+        REQUIRE_THAT( result.at( y ), Catch::Matchers::WithinRel( diff( z, y ).eval(), 1e-14 ) );
+
+        const auto partial = metal::eval_with_gradient( z, y );
+        REQUIRE( partial.Size == 1 );
+        REQUIRE_THAT( partial.at< "y" >(), Catch::Matchers::WithinULP( result.at( y ), 0 ) );
+    }
+
+    SECTION( "Test with bindings" )
+    {
+        const metal::Double< "x" > x;
+        const metal::Double< "y" > y;
+
+        const auto z = foo( x, y );
+        const metal::Bindings point{ metal::bind< "x" >( 3.0 ), metal::bind< "y" >( 4.0 ) };
+        const auto result = metal::eval_with_gradient( z, point, x, y );
+
+        REQUIRE_THAT( result.value(), Catch::Matchers::WithinULP( z.eval( point ), 0 ) );
+        REQUIRE_THAT( result.at( x ), Catch::Matchers::WithinRel( diff( z, x ).eval( point ), 1e-14 ) );
+        REQUIRE_THAT( result.at( y ), Catch::Matchers::WithinRel( diff( z, y ).eval( point ), 1e-14 ) );
+    }
+}
+
+
+TEST_CASE( "Test Hessian" )
+{
+    DOUBLE( x, 1.5 );
+    DOUBLE( y, 2.0 );
+
+    const auto z = foo( x, y ) + sin( x ) * cos( y ) + x / y;
+    const auto result = metal::hessian( z );
+
+    REQUIRE( result.PackedSize == 3 );
+    REQUIRE_THAT( result.value(), Catch::Matchers::WithinRel( z.eval(), 1e-15 ) );
+    REQUIRE_THAT( result.gradient().at( y ), Catch::Matchers::WithinRel( diff( z, y ).eval(), 1e-14 ) );
+    REQUIRE_THAT( result.at( x, x ), Catch::Matchers::WithinRel( diff( diff( z, x ), x ).eval(), 1e-13 ) );
+    REQUIRE_THAT( result.at( x, y ), Catch::Matchers::WithinRel( diff( diff( z, x ), y ).eval(), 1e-13 ) );
+    REQUIRE_THAT( result.at( y, y ), Catch::Matchers::WithinRel( diff( diff( z, y ), y ).eval(), 1e-13 ) );
+    REQUIRE( result.at< "y", "x" >() == result.at< "x", "y" >() );
+    REQUIRE( result.dense()[1][0] == result( 0, 1 ) );
+
+    const metal::Bindings point{ metal::bind< "x" >( 3.0 ) };
+    const auto bound = metal::hessian( z, point );
+    REQUIRE_THAT( bound.at( x, y ), Catch::Matchers::WithinRel( diff( diff( z, x ), y ).eval( point ), 1e-13 ) );
+}
+
+
+TEST_CASE( "Test cost model" )
+{
+    SECTION( "Test static operation counts" )
+    {
+        DOUBLE( x, 1.5 );
+        DOUBLE( y, 2.0 );
+
+        // 2 * pi * sqrt(x^3 / y)
+        const auto z = foo( x, y );
+        constexpr auto cost = metal::cost< decltype( z ) >();
+        STATIC_REQUIRE( cost.ops == metal::OpCounts{ .multiply = 3, .divide = 1, .sqrt = 1 } );
+        STATIC_REQUIRE( cost.nodes == 7 );
+        STATIC_REQUIRE( cost.depth == 5 );
+        STATIC_REQUIRE( cost.distinct == 4 );
+
+        const auto e = sin( x ) * cos( x + 1.0 ) + sin( x );
+        STATIC_REQUIRE( metal::cost( e ).ops == metal::OpCounts{ .add = 2, .multiply = 1, .sin = 2, .cos = 1 } );
+        STATIC_REQUIRE( metal::cost( e ).distinct_ops.sin == 1 );
+        STATIC_REQUIRE( metal::cost( e ).distinct_ops.transcendental() == 2 );
+
+        const auto d4 = diff( diff( diff( diff( z, x ), x ), x ), x );
+        STATIC_REQUIRE( metal::cost( d4 ).distinct_ops.total() < metal::cost( d4 ).ops.total() );
+    }
+
+    SECTION( "Test executed operations match the static counts" )
+    {
+        DOUBLE( x, 1.5 );
+        DOUBLE( y, 2.0 );
+
+        const auto z = diff( diff( foo( x, y ), x ), y ) + sin( x ) * cos( y );
+        REQUIRE( metal::count_ops( z ) == metal::cost( z ).ops );
+        REQUIRE( metal::count_ops( z, metal::Bindings{ metal::bind< "x" >( 3.0 ) } ) == metal::cost( z ).ops );
+
+        const auto e = sin( x ) * cos( x + 1.0 ) + sin( x );
+        REQUIRE( metal::count_ops( metal::cse( e ) ) == metal::cost( e ).distinct_ops );
+        REQUIRE( metal::executed_ops().sin > 0 );
+    }
+}
+
+
+TEST_CASE( "Test expression storage" )
+{
+    DOUBLE( x, 1.5 );
+    DOUBLE( y, 2.0 );
+
+    // Leaves without runtime constants take no space inside their parents
+    STATIC_REQUIRE( sizeof( metal::Multiply< metal::Pi, metal::TwoPi > ) == 1 );
+    STATIC_REQUIRE( sizeof( metal::Add< metal::One, decltype( x ) > ) == sizeof( double ) );
+
+    const auto period = metal::TwoPi{} * sqrt( cube( x ) / y );
+    STATIC_REQUIRE( sizeof( period ) == 2 * sizeof( double ) );
+    REQUIRE_THAT( period.eval(), Catch::Matchers::WithinULP( foo( 1.5, 2.0 ), 0 ) );
+
+    const auto dpdx = diff( period, x );
+    STATIC_REQUIRE( sizeof( dpdx ) < sizeof( diff( foo( x, y ), x ) ) );
+}
+
+
+/** Type looking like an expression, formatted by its own formatter */
+struct Reading
+{
+    double eval() const { return 1.25; }
+    std::string str() const { return "reading"; }
+};
+
+template<>
+struct fmt::formatter< Reading >
+{
+    constexpr auto parse( fmt::format_parse_context& context ) { return context.begin(); }
+
+    template< typename Context >
+    auto format( const Reading&, Context& context ) const
+    {
+        return fmt::format_to( context.out(), "sensor" );
+    }
+};
+
+
+TEST_CASE( "Test expression formatting" )
+{
+    DOUBLE( x, 1.5 );
+    DOUBLE( y, 2.0 );
+
+    const auto z = metal::Pi{} * square( x ) - sin( x ) / cos( y ) + 0.5 * y;
+    REQUIRE( z.str() == "(((Pi * x^2) - (sin(x) / cos(y))) + (0.5 * y))" );
+    REQUIRE( fmt::format( "z = {}", z ) == "z = " + z.str() );
+    REQUIRE( fmt::format( "{}", metal::cse( z ) ) == z.str() );
+
+    const auto dzdx = diff( diff( z, x ), x );
+    std::string text;
+    fmt::format_to( std::back_inserter( text ), "{}", dzdx );
+    REQUIRE( text == dzdx.str() );
+
+    // Types without runtime constants are rendered at compile time
+    using Stateless = decltype( sin( x ) * cos( y ) + metal::TwoPi{} );
+    STATIC_REQUIRE( metal::static_str< Stateless > == "((sin(x) * cos(y)) + TwoPi)" );
+    REQUIRE( metal::static_str< Stateless > == ( sin( x ) * cos( y ) + metal::TwoPi{} ).str() );
+
+    // Only metal nodes are captured by the expression formatter
+    STATIC_REQUIRE( metal::detail::ExpressionNode< decltype( z ) > );
+    STATIC_REQUIRE( metal::detail::ExpressionNode< decltype( metal::cse( z ) ) > );
+    STATIC_REQUIRE( metal::detail::ExpressionNode< metal::Constant< double > > );
+    STATIC_REQUIRE( !metal::detail::ExpressionNode< Reading > );
+    REQUIRE( fmt::format( "{}", Reading{} ) == "sensor" );
+
+    STATIC_REQUIRE( metal::detail::valid_format( "({0} + {1})", 2 ) );
+    STATIC_REQUIRE( !metal::detail::valid_format( "({0} + {1})", 1 ) );
+    STATIC_REQUIRE( !metal::detail::valid_format( "f({", 1 ) );
+    STATIC_REQUIRE( !metal::detail::valid_format( "{0:x}", 1 ) );
+    STATIC_REQUIRE( !metal::detail::valid_format( "x}", 1 ) );
+}
+
+
+TEST_CASE( "Test batch evaluation" )
+{
+    SECTION( "Test batch matches scalar evaluation" )
+    {
+        constexpr int num = 37;
+        std::vector< double > xs( num );
+        std::vector< double > ys( num );
+        for ( int i = 0; i < num; i++ )
+        {
+            xs[i] = 1.0 + 0.1 * i;
+            ys[i] = 2.0 + 0.05 * i;
+        }
+
+        DOUBLE( x, 0.0 );
+        DOUBLE( y, 0.0 );
+        const auto z = foo( x, y ) + sin( x ) * cos( y ) - 1;
+        const auto dzdx = diff( z, x );
+
+        std::vector< double > values( num );
+        std::vector< double > derivs( num );
+        metal::eval_batch( z, std::span{ values }, metal::column< "x" >( xs ), metal::column< "y" >( ys ) );
+        metal::eval_batch( dzdx, std::span{ derivs }, metal::column< "x" >( xs ), metal::column< "y" >( ys ) );
+
+        for ( int i = 0; i < num; i++ )
+        {
+            const metal::Double< "x" > xi{ xs[i] };
+            const metal::Double< "y" > yi{ ys[i] };
+            const auto zi = foo( xi, yi ) + sin( xi ) * cos( yi ) - 1;
+            REQUIRE_THAT( values[i], Catch::Matchers::WithinRel( zi.eval(), 1e-15 ) );
+            REQUIRE_THAT( derivs[i], Catch::Matchers::WithinRel( diff( zi, xi ).eval(), 1e-15 ) );
+        }
+    }
+
+    SECTION( "Test unbound variables keep their value" )
+    {
+        const std::vector< double > xs{ 1.0, 2.0, 3.0 };
+        DOUBLE( x, 0.0 );
+        DOUBLE( y, 10.0 );
+
+        std::vector< double > values( xs.size() );
+        metal::eval_batch( x * y, std::span{ values }, metal::column< "x" >( xs ) );
+        REQUIRE( values == std::vector< double >{ 10.0, 20.0, 30.0 } );
+
+        std::vector< double > wrong( 2 );
+        REQUIRE_THROWS( metal::eval_batch( x * y, std::span{ wrong }, metal::column< "x" >( xs ) ) );
+    }
+
+    SECTION( "Test square roots of lanes are exact" )
+    {
+        // Vector instructions are correctly rounded like std::sqrt, at native and other widths
+        const auto check = []< typename T, int Width >( metal::simd::Lanes< T, Width > )
+        {
+            T data[Width];
+            for ( int i = 0; i < Width; ++i )
+            {
+                data[i] = T( 0.5 ) + T( 1.75 ) * i;
+            }
+            const auto result = sqrt( metal::simd::Lanes< T, Width >::load( data ) );
+            for ( int i = 0; i < Width; ++i )
+            {
+                REQUIRE( result[i] == std::sqrt( data[i] ) );
+            }
+        };
+        check( metal::simd::Lanes< double, metal::simd::NativeWidth< double > >{} );
+        check( metal::simd::Lanes< float, metal::simd::NativeWidth< float > >{} );
+        check( metal::simd::Lanes< double, 2 >{} );
+        check( metal::simd::Lanes< double, 16 >{} );
+        check( metal::simd::Lanes< float, 4 >{} );
+    }
+
+    SECTION( "Test sines and cosines of lanes match the scalar functions" )
+    {
+        // Arguments beyond the reduction of the vector kernel, infinite or NaN, are computed lane by lane
+        const auto check = []< typename T, int Width >( metal::simd::Lanes< T, Width >, const T last )
+        {
+            T data[Width];
+            for ( int i = 0; i < Width; ++i )
+            {
+                data[i] = i % 2 == 0 ? T( 0.37 ) * i * i * i : T( -1.9 ) * i;
+            }
+            data[1] = T( -0.0 );
+            data[Width - 1] = last;
 
-        // using SMA = Variable< 0 >;
-        // using GM = Variable< 1 >;
-        // auto sma = SMA{};
-        // auto gm = GM{};
-
-        // const auto per = orbital_period( sma, gm );
-        // const auto per_diff_sma = diff( per, sma );
-        // const auto per_diff_gm = diff( per, gm );
-
-        // std::cout << per.str() << std::endl;
-        // std::cout << per_diff_sma.str() << std::endl;
-        // std::cout << per_diff_gm.str() << std::endl;
-
-        // const double eps = 0.1;
-        // const std::tuple a{ 6628.14, 398600.44 };
-        // std::cout << per.eval( a ) << std::endl;
-        
-        // const std::tuple a1{ 6628.14 + eps, 398600.44 };
-        // const std::tuple a2{ 6628.14, 398600.44 + eps };
-        // const auto y0 = per.eval( a );
-        // const auto y1 = per.eval( a1 );
-        // const auto y2 = per.eval( a2 );
-
-        // std::cout << per.eval( a ) << std::endl;
-        // std::cout << per_diff_sma.eval( a ) << std::endl;
-        // std::cout << ( y1 - y0 ) / eps << std::endl;
-        // std::cout << per_diff_gm.eval( a ) << std::endl;
-        // std::cout << ( y2 - y0 ) / eps << std::endl;
+            const auto lanes = metal::simd::Lanes< T, Width >::load( data );
+            const auto [s, c] = sincos( lanes );
+            const auto sine = sin( lanes );
+            const auto cosine = cos( lanes );
+            for ( int i = 0; i < Width; ++i )
+            {
+                if ( std::isnan( std::sin( data[i] ) ) )
+                {
+                    REQUIRE( ( std::isnan( s[i] ) && std::isnan( c[i] ) ) );
+                    REQUIRE( ( std::isnan( sine[i] ) && std::isnan( cosine[i] ) ) );
+                    continue;
+                }
+                REQUIRE_THAT( sine[i], Catch::Matchers::WithinULP( std::sin( data[i] ), 2 ) );
+                REQUIRE_THAT( cosine[i], Catch::Matchers::WithinULP( std::cos( data[i] ), 2 ) );
+                REQUIRE( std::signbit( sine[i] ) == std::signbit( std::sin( data[i] ) ) );
+                REQUIRE( s[i] == sine[i] );
+                REQUIRE( c[i] == cosine[i] );
+            }
+        };
+        check( metal::simd::Lanes< double, metal::simd::NativeWidth< double > >{}, 1e5 );
+        check( metal::simd::Lanes< float, metal::simd::NativeWidth< float > >{}, -1e5f );
+        check( metal::simd::Lanes< double, 2 >{}, 1e10 );
+        check( metal::simd::Lanes< double, 16 >{}, -1e10 );
+        check( metal::simd::Lanes< float, 4 >{}, std::numeric_limits< float >::quiet_NaN() );
+        check( metal::simd::Lanes< double, 2 >{}, std::numeric_limits< double >::infinity() );
     }
 }
@@ -0,0 +1,21 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "Model.hpp"
+#include "metal/Codegen.hpp"
+
+#include <fstream>
+#include <iostream>
+
+
+/** Write the source of the function evaluating the test model to the given file */
+int main( int argc, char** argv )
+{
+    if ( argc != 2 )
+    {
+        std::cerr << "Usage: generate_model <output>" << std::endl;
+        return 1;
+    }
+    std::ofstream file{ argv[1] };
+    file << metal::generate_cpp( model_program(), "model" );
+    return file ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+/** Copyright Gabor Varga 2023 */
+
+#ifndef METAL_TESTS_MODEL_HPP
+#define METAL_TESTS_MODEL_HPP
+
+#include "metal/Program.hpp"
+
+
+/**
+ * Program of several outputs, generated into C++ at build time by generate_model and compiled into
+ * test_codegen, which compares the generated function with the program
+ */
+inline metal::Program model_program()
+{
+    DOUBLE( x, 0.7 );
+    DOUBLE( y, 1.3 );
+
+    // Linked sine and cosine, contractible products, negative constants and unlinked trigonometry
+    const auto z = sin( x * y ) * cos( x * y ) + x * y - 2.5 * square( y ) / x;
+    const auto w = -sqrt( cube( x ) ) / y + sin( y ) - 0.5;
+    return metal::compile( std::tuple{ z, diff( z, x ), diff( z, y ), w, diff( w, y ) } );
+}
+
+#endif
@@ -3,6 +3,9 @@
 #include "metal/Parameter.hpp"
 
 #include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
 #include <catch2/catch_test_macros.hpp>
 
 
@@ -16,15 +19,28 @@ TEST_CASE( "Test Parameter construction id" )
         REQUIRE( p2.id() == 2 );
 
         constexpr int num = 10000;
-        const auto foo = [](){
+        std::vector< metal::Parameter::Id > ids1;
+        std::vector< metal::Parameter::Id > ids2;
+        const auto foo = []( std::vector< metal::Parameter::Id >& ids ){
             for ( int i = 0; i < num; i++ )
-                const auto p = metal::Parameter{};
+                ids.push_back( metal::Parameter{}.id() );
         };
-        auto th1 = std::thread( foo );
-        auto th2 = std::thread( foo );
+        auto th1 = std::thread( foo, std::ref( ids1 ) );
+        auto th2 = std::thread( foo, std::ref( ids2 ) );
 
         th1.join();
         th2.join();
-        REQUIRE( metal::Parameter{}.id() == 2 * num + 3 );
+
+        // Ids increase within a thread and are unique across threads
+        REQUIRE( std::ranges::is_sorted( ids1 ) );
+        REQUIRE( std::ranges::is_sorted( ids2 ) );
+        std::vector< metal::Parameter::Id > ids = ids1;
+        ids.insert( ids.end(), ids2.begin(), ids2.end() );
+        std::ranges::sort( ids );
+        REQUIRE( std::ranges::adjacent_find( ids ) == ids.end() );
+        REQUIRE( ids.back() <= 2 * num + 3 * metal::Parameter::BlockSize );
+
+        // The main thread continues its own block
+        REQUIRE( metal::Parameter{}.id() == 3 );
     }
 }
@@ -0,0 +1,108 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Pattern.hpp"
+#include "metal/Dual.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+
+
+TEST_CASE( "Test interned patterns" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter p2{};
+    const metal::Parameter p3{};
+
+    SECTION( "Test equal parameter sets share a pattern" )
+    {
+        const auto a = metal::Pattern::intern( { p2, p1 } );
+        const auto b = metal::Pattern::intern( { p1, p2, p1 } );
+        REQUIRE( a == b );
+        REQUIRE( &a.parameters() == &b.parameters() );
+        REQUIRE( a.parameters() == std::vector< metal::Parameter >{ p1, p2 } );
+        REQUIRE( a != metal::Pattern::intern( { p1 } ) );
+        REQUIRE( metal::Pattern{} == metal::Pattern::intern( {} ) );
+
+        REQUIRE( a.find( p2 ) == 1 );
+        REQUIRE( a.find( p3 ) == -1 );
+    }
+
+    SECTION( "Test union of patterns is cached" )
+    {
+        const auto a = metal::Pattern::intern( { p1, p3 } );
+        const auto b = metal::Pattern::intern( { p2, p3 } );
+        const auto merged = a.unite( b );
+        REQUIRE( merged.left.data() == a.unite( b ).left.data() );
+        REQUIRE( merged.pattern == metal::Pattern::intern( { p1, p2, p3 } ) );
+        REQUIRE( std::ranges::equal( merged.left, std::vector< int >{ 0, 2 } ) );
+        REQUIRE( std::ranges::equal( merged.right, std::vector< int >{ 1, 2 } ) );
+    }
+
+    SECTION( "Test patterns are released with their last handle" )
+    {
+        const auto before = metal::Pattern::interned();
+        {
+            const auto a = metal::Pattern::intern( { p1, p2, p3 } );
+            const auto b = metal::Pattern::intern( { p3 } );
+            const auto c = metal::Pattern::intern( { p1, p2 } );
+            REQUIRE( metal::Pattern::interned() == before + 3 );
+
+            // A union equal to one side must not keep that side alive through its own cache
+            REQUIRE( a.unite( b ).pattern == a );
+            REQUIRE( c.unite( b ).pattern == a );
+            {
+                const auto d = metal::Pattern::intern( { p2, p3 } );
+                REQUIRE( std::ranges::equal( c.unite( d ).right, std::vector< int >{ 1, 2 } ) );
+            }
+            REQUIRE( metal::Pattern::interned() == before + 3 );
+        }
+        REQUIRE( metal::Pattern::interned() == before );
+
+        // Interned again after release, with a fresh union cache
+        const auto a = metal::Pattern::intern( { p1, p3 } );
+        const auto b = metal::Pattern::intern( { p2 } );
+        REQUIRE( a.unite( b ).pattern.parameters() == std::vector< metal::Parameter >{ p1, p2, p3 } );
+        REQUIRE( metal::Pattern::interned() == before + 2 );
+    }
+}
+
+
+TEST_CASE( "Test Gradient with interned pattern" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter p2{};
+    const metal::Parameter p3{};
+
+    const auto pattern = metal::Pattern::intern( { p1, p2 } );
+    const metal::PatternGradient< double > x{ pattern, { 1.0, 2.0 } };
+    const metal::PatternGradient< double > y{ pattern, { 3.0, 4.0 } };
+    const metal::PatternGradient< double > z{ metal::Gradient< double, 2 >{ { p2, p3 }, { 5.0, 6.0 } } };
+
+    SECTION( "Test same pattern arithmetic" )
+    {
+        const auto sum = x + y;
+        REQUIRE( sum.pattern() == pattern );
+        REQUIRE( sum.value() == std::vector< double >{ 4.0, 6.0 } );
+        REQUIRE( axpy( 2.0, x, y ).value() == std::vector< double >{ 5.0, 8.0 } );
+        REQUIRE( ( -x * 2.0 ).value() == std::vector< double >{ -2.0, -4.0 } );
+    }
+
+    SECTION( "Test different pattern arithmetic" )
+    {
+        const auto difference = x - z;
+        REQUIRE( difference.parameters() == std::vector< metal::Parameter >{ p1, p2, p3 } );
+        REQUIRE( difference.value() == std::vector< double >{ 1.0, -3.0, -6.0 } );
+        REQUIRE( difference.at( p3 ) == -6.0 );
+        REQUIRE_THROWS_AS( x.at( p3 ), metal::ParameterNotFoundException );
+        REQUIRE_THROWS_AS( ( metal::PatternGradient< double >{ pattern, { 1.0 } } ), std::invalid_argument );
+    }
+
+    SECTION( "Test dual number with pattern gradient derivative" )
+    {
+        const metal::Dual< double, metal::PatternGradient< double > > u{ 2.0, x };
+        const metal::Dual< double, metal::PatternGradient< double > > v{ 3.0, y };
+        const auto w = u * v;
+        REQUIRE( w.value() == 6.0 );
+        REQUIRE( w.deriv().value() == std::vector< double >{ 1.0 * 3.0 + 3.0 * 2.0, 2.0 * 3.0 + 4.0 * 2.0 } );
+    }
+}
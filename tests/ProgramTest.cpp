@@ -0,0 +1,256 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Program.hpp"
+#include "metal/Graph.hpp"
+#include "metal/Codegen.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+
+constexpr auto foo( auto x, auto y )
+{
+    return 2 * M_PI * sqrt( cube( x ) / y );
+}
+
+
+TEST_CASE( "Test program compilation" )
+{
+    SECTION( "Test compiled program matches expression" )
+    {
+        DOUBLE( x, 1.5 );
+        DOUBLE( y, 2.0 );
+
+        const auto z = foo( x, y ) + sin( x ) * cos( y );
+        const auto dzdx = diff( z, x );
+        const auto program = metal::compile( dzdx );
+
+        REQUIRE( program.variables() == std::vector< std::string >{ "x", "y" } );
+        REQUIRE_THAT( program.eval(), Catch::Matchers::WithinULP( dzdx.eval(), 0 ) );
+
+        const std::vector< double > inputs{ 2.5, 3.0 };
+        const auto expected = dzdx.eval( metal::Bindings{ metal::bind< "x" >( 2.5 ), metal::bind< "y" >( 3.0 ) } );
+        REQUIRE_THAT( program.eval( inputs ), Catch::Matchers::WithinULP( expected, 0 ) );
+
+        std::vector< double > registers( program.size() );
+        REQUIRE_THAT( program.eval( inputs, registers ), Catch::Matchers::WithinULP( expected, 0 ) );
+
+        REQUIRE_THROWS( program.eval( std::vector< double >{ 1.0 } ) );
+    }
+
+    SECTION( "Test identical subexpressions are stored once" )
+    {
+        DOUBLE( x, 0.5 );
+
+        const auto z = sin( x ) * sin( x ) + ( x + 1.0 ) * sin( x + 1.0 );
+        const auto program = metal::compile( z );
+
+        // x, sin(x), sin(x)^2, 1.0, x + 1, sin(x + 1), product, sum
+        REQUIRE( program.size() == 8 );
+        REQUIRE( program.constants().size() == 1 );
+        REQUIRE_THAT( program.eval(), Catch::Matchers::WithinULP( z.eval(), 0 ) );
+    }
+
+    SECTION( "Test sine and cosine of the same argument are computed together" )
+    {
+        DOUBLE( x, 0.5 );
+        DOUBLE( y, 2.0 );
+
+        const auto z = sin( x * y ) / cos( x * y ) + cos( x );
+        const auto program = metal::compile( z );
+        const auto& instructions = program.instructions();
+
+        int linked = 0;
+        for ( int i = 0; i < program.size(); ++i )
+        {
+            if ( instructions[i].code == metal::OpCode::Sin || instructions[i].code == metal::OpCode::Cos )
+            {
+                const auto sibling = instructions[i].right;
+                linked += sibling >= 0;
+                REQUIRE( ( sibling < 0 || instructions[sibling].right == i ) );
+            }
+        }
+        REQUIRE( linked == 2 );
+        REQUIRE_THAT( program.eval(), Catch::Matchers::WithinULP( z.eval(), 0 ) );
+
+        std::vector< double > gradient( 2 );
+        program.gradient( program.values(), gradient );
+        REQUIRE_THAT( gradient[0], Catch::Matchers::WithinRel( diff( z, x ).eval(), 1e-14 ) );
+        REQUIRE_THAT( gradient[1], Catch::Matchers::WithinRel( diff( z, y ).eval(), 1e-14 ) );
+    }
+
+    SECTION( "Test building a program by hand" )
+    {
+        metal::ProgramBuilder builder;
+        const auto x = builder.variable( "x", 3.0 );
+        const auto two = builder.constant( 2.0 );
+        const auto product = builder.apply( metal::OpCode::Multiply, two, x );
+        REQUIRE( builder.apply( metal::OpCode::Multiply, two, x ) == product );
+        REQUIRE_THROWS( builder.apply( metal::OpCode::Add, product, 10 ) );
+
+        const auto program = builder.build( product );
+        REQUIRE( program.eval() == 6.0 );
+    }
+
+    SECTION( "Test programs with invalid instructions are rejected" )
+    {
+        using metal::OpCode;
+        const std::vector< double > constants{ 2.0 };
+        const std::vector< std::string > variables{ "x" };
+        const std::vector< double > values{ 3.0 };
+        const auto build = [&]( std::vector< metal::Instruction > instructions )
+        {
+            return metal::Program{ std::move( instructions ), constants, variables, values, 0 };
+        };
+
+        REQUIRE( build( { { OpCode::Constant, 0, -1 } } ).eval() == 2.0 );
+        REQUIRE_THROWS_AS( build( { { OpCode::Constant, 1, -1 } } ), std::invalid_argument );
+        REQUIRE_THROWS_AS( build( { { OpCode::Variable, -1, -1 } } ), std::invalid_argument );
+        REQUIRE_THROWS_AS( build( { { OpCode::Negate, 0, -1 } } ), std::invalid_argument );
+        REQUIRE_THROWS_AS( build( { { OpCode::Variable, 0, -1 }, { OpCode::Add, 0, 1 } } ), std::invalid_argument );
+        REQUIRE_THROWS_AS( build( { { OpCode::Variable, 0, -1 }, { OpCode::Sin, 2, -1 } } ), std::invalid_argument );
+        REQUIRE_THROWS_AS( metal::Program( { { OpCode::Variable, 0, -1 } }, constants, variables, {}, 0 ),
+            std::invalid_argument );
+    }
+}
+
+
+TEST_CASE( "Test program gradient" )
+{
+    DOUBLE( x, 1.5 );
+    DOUBLE( y, 2.0 );
+
+    const auto z = foo( x, y ) / y - sin( x ) * cos( y ) + square( x - y );
+    const auto program = metal::compile( z );
+    const auto expected = metal::gradient( z );
+
+    std::vector< double > gradient( 2 );
+    REQUIRE_THAT( program.gradient( program.values(), gradient ), Catch::Matchers::WithinULP( z.eval(), 0 ) );
+    REQUIRE_THAT( gradient[0], Catch::Matchers::WithinRel( expected.at< "x" >(), 1e-14 ) );
+    REQUIRE_THAT( gradient[1], Catch::Matchers::WithinRel( expected.at< "y" >(), 1e-14 ) );
+
+    std::vector< double > workspace( program.size() );
+    REQUIRE_THROWS( program.gradient( program.values(), gradient, workspace ) );
+}
+
+
+TEST_CASE( "Test runtime graph" )
+{
+    metal::Graph graph;
+    const auto x = graph.variable( "x", 1.5 );
+    const auto y = graph.variable( "y", 2.0 );
+
+    // Same structure as the compile time expression, built from runtime nodes
+    const auto z = 2 * M_PI * sqrt( cube( x ) / y ) + sin( x ) * cos( y );
+    REQUIRE( sin( x ) == sin( x ) );
+
+    DOUBLE( u, 1.5 );
+    DOUBLE( v, 2.0 );
+    const auto expected = foo( u, v ) + sin( u ) * cos( v );
+    const auto program = graph.compile( z );
+    REQUIRE_THAT( program.eval(), Catch::Matchers::WithinULP( expected.eval(), 0 ) );
+
+    std::vector< double > gradient( 2 );
+    program.gradient( program.values(), gradient );
+    REQUIRE_THAT( gradient[0], Catch::Matchers::WithinRel( diff( expected, u ).eval(), 1e-14 ) );
+    REQUIRE_THAT( gradient[1], Catch::Matchers::WithinRel( diff( expected, v ).eval(), 1e-14 ) );
+
+    metal::Graph other;
+    const auto w = other.variable( "w", 1.0 );
+    REQUIRE_THROWS( x + w );
+    REQUIRE_THROWS_AS( other.apply( metal::OpCode::Sin, x ), std::invalid_argument );
+    REQUIRE_THROWS_AS( graph.apply( metal::OpCode::Add, x, w ), std::invalid_argument );
+    REQUIRE_THROWS_AS( graph.compile( w ), std::invalid_argument );
+
+    // The same name is the same variable, it cannot have another value
+    REQUIRE( graph.variable( "x", 1.5 ) == x );
+    REQUIRE_THROWS_AS( graph.variable( "x", 2.5 ), std::invalid_argument );
+
+    // Nodes point to their graph, which therefore stays in place
+    STATIC_REQUIRE( !std::is_copy_constructible_v< metal::Graph > );
+    STATIC_REQUIRE( !std::is_move_constructible_v< metal::Graph > );
+    STATIC_REQUIRE( !std::is_move_assignable_v< metal::Graph > );
+}
+
+
+TEST_CASE( "Test runtime graph of many variables" )
+{
+    // Variables are looked up by name, each one keeps the slot of its first use
+    metal::Graph graph;
+    auto sum = graph.constant( 0.0 );
+    for ( int i = 0; i < 2000; ++i )
+    {
+        sum = sum + graph.variable( fmt::format( "x{0}", i ), i );
+    }
+    for ( int i = 0; i < 2000; i += 2 )
+    {
+        sum = sum + graph.variable( fmt::format( "x{0}", i ), i );
+    }
+
+    const auto program = graph.compile( sum );
+    REQUIRE( program.variables().size() == 2000 );
+    REQUIRE( program.variables()[1234] == "x1234" );
+    REQUIRE( program.eval() == 2000.0 * 1999.0 / 2.0 + 1000.0 * 999.0 );
+
+    std::vector< double > gradient( 2000 );
+    program.gradient( program.values(), gradient );
+    REQUIRE( gradient[0] == 2.0 );
+    REQUIRE( gradient[1] == 1.0 );
+}
+
+
+TEST_CASE( "Test Jacobian of several outputs" )
+{
+    DOUBLE( sma, 7000.0 );
+    DOUBLE( gm, 398600.0 );
+
+    // Orbital period and mean motion share the cube of the semi-major axis and the quotient
+    const auto ratio = cube( sma ) / gm;
+    const auto period = 2 * M_PI * sqrt( ratio );
+    const auto motion = 1.0 / sqrt( ratio );
+    const auto outputs = std::tuple{ period, motion, gm / sma };
+
+    const auto program = metal::compile( outputs );
+    REQUIRE( program.outputs().size() == 3 );
+    REQUIRE( program.size() < metal::compile( period ).size() + metal::compile( motion ).size() );
+
+    const auto result = metal::jacobian( outputs );
+    REQUIRE( result.rows() == 3 );
+    REQUIRE( result.cols() == 2 );
+    REQUIRE_THAT( result.values()[0], Catch::Matchers::WithinULP( period.eval(), 0 ) );
+    REQUIRE_THAT( result.values()[1], Catch::Matchers::WithinULP( motion.eval(), 0 ) );
+    REQUIRE_THAT( result.at( 0, "sma" ), Catch::Matchers::WithinRel( diff( period, sma ).eval(), 1e-14 ) );
+    REQUIRE_THAT( result.at( 1, "gm" ), Catch::Matchers::WithinRel( diff( motion, gm ).eval(), 1e-14 ) );
+    REQUIRE_THAT( result( 2, 0 ), Catch::Matchers::WithinRel( diff( gm / sma, sma ).eval(), 1e-14 ) );
+    REQUIRE_THROWS( result.at( 0, "x" ) );
+}
+
+
+TEST_CASE( "Test C++ code generation" )
+{
+    DOUBLE( x, 0.7 );
+    DOUBLE( y, 1.3 );
+
+    const auto z = sin( x * y ) * cos( x * y ) + x * y - 2.5 * square( y ) / x;
+    const auto source = metal::generate_cpp( std::tuple{ z, diff( z, x ) }, "model" );
+
+    REQUIRE( source.find( "void model( const double* inputs, double* outputs )" ) != std::string::npos );
+    REQUIRE( source.find( "const double t0 = inputs[0];" ) != std::string::npos );
+    REQUIRE( source.find( "#define METAL_SINCOS( x, s, c ) __builtin_sincos( x, s, c )" ) != std::string::npos );
+    REQUIRE( source.find( "METAL_SINCOS( t2, &t3, &t4 );" ) != std::string::npos );
+    REQUIRE( source.find( "std::fma( t3, t4, t2 )" ) != std::string::npos );
+    REQUIRE( source.find( "outputs[1] = " ) != std::string::npos );
+
+    // Constants are inlined, instructions no output depends on are dropped
+    metal::ProgramBuilder builder;
+    const auto a = builder.variable( "a", 1.0 );
+    const auto unused = builder.apply( metal::OpCode::SquareRoot, a );
+    const auto product = builder.apply( metal::OpCode::Multiply, a, builder.constant( -0.5 ) );
+    const auto program = builder.build( product );
+    const auto generated = metal::generate_cpp( program, "half" );
+    REQUIRE( generated.find( fmt::format( "t{0}", unused ) ) == std::string::npos );
+    REQUIRE( generated.find( "const double t3 = t0 * ( -0.5 );" ) != std::string::npos );
+    REQUIRE( generated.find( "METAL_SINCOS" ) == std::string::npos );
+
+    REQUIRE_THROWS( metal::generate_cpp( program, "2x" ) );
+}
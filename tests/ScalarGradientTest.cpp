@@ -1,7 +1,12 @@
 /** Copyright Gabor Varga 2023 */
 
+#include "Allocations.hpp"
 #include "metal/ScalarGradient.hpp"
+#include "metal/IndexedGradient.hpp"
+#include "metal/Dual.hpp"
 
+#include <cmath>
+#include <thread>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
@@ -22,3 +27,150 @@ TEST_CASE( "Test Gradient construction id" )
         REQUIRE_THAT( 1.5, Catch::Matchers::WithinULP( g.at( p ), 0 ) );
     }
 }
+
+
+TEST_CASE( "Test Gradient arithmetic" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter p2{};
+    const metal::Parameter p3{};
+
+    const metal::Gradient< double, 2 > x{ { p1, p2 }, { 1.0, 2.0 } };
+    const metal::Gradient< double, 2 > y{ { p2, p3 }, { 3.0, 4.0 } };
+
+    SECTION( "Test addition and subtraction merge parameters" )
+    {
+        const auto sum = x + y;
+        REQUIRE( sum.parameters() == metal::SmallVector< metal::Parameter, 4 >{ p1, p2, p3 } );
+        REQUIRE( sum.value() == metal::SmallVector< double, 4 >{ 1.0, 5.0, 4.0 } );
+
+        const auto difference = x - y;
+        REQUIRE( difference.parameters() == metal::SmallVector< metal::Parameter, 4 >{ p1, p2, p3 } );
+        REQUIRE( difference.value() == metal::SmallVector< double, 4 >{ 1.0, -1.0, -4.0 } );
+    }
+
+    SECTION( "Test scaling keeps the size" )
+    {
+        const metal::Gradient< double, 2 > scaled = 2.0 * -x;
+        REQUIRE( scaled.value() == std::array< double, 2 >{ -2.0, -4.0 } );
+
+        const auto result = metal::axpy( 2.0, x, y );
+        REQUIRE( result.value() == metal::SmallVector< double, 4 >{ 2.0, 7.0, 4.0 } );
+    }
+
+    SECTION( "Test dynamic gradient with inline storage" )
+    {
+        const metal::Gradient< double, -1, 4 > u{ { p1, p3 }, { 1.0, 2.0 } };
+        const auto sum = u + y;
+        static_assert( std::is_same_v< decltype( sum ), const metal::Gradient< double, -1, 4 > > );
+        REQUIRE( sum.parameters().is_inline() );
+        REQUIRE( sum.value() == metal::SmallVector< double, 4 >{ 1.0, 3.0, 6.0 } );
+        REQUIRE( sum.at( p3 ) == 6.0 );
+    }
+
+    SECTION( "Test overlapping gradients merge without allocations when the union fits inline" )
+    {
+        const metal::Gradient< double, -1, 2 > u{ { p1, p2 }, { 1.0, 2.0 } };
+        const metal::Gradient< double, -1, 2 > v{ { p1, p2 }, { 3.0, 4.0 } };
+        const metal::Gradient< double, 2 > w{ { p1, p2 }, { 5.0, 6.0 } };
+
+        const auto before = heap_allocations();
+        const auto sum = u + v;
+        const auto result = metal::chain( sum, 2.0, w, 3.0 );
+        REQUIRE( heap_allocations() == before );
+
+        REQUIRE( result.parameters().is_inline() );
+        REQUIRE( result.value() == metal::SmallVector< double, 2 >{ 23.0, 30.0 } );
+        REQUIRE( ( u + y ).value() == metal::SmallVector< double, 2 >{ 1.0, 5.0, 4.0 } );
+    }
+
+    SECTION( "Test fixed-size gradients merge into inline storage" )
+    {
+        const metal::Gradient< double, 2 > u{ { p1, p2 }, { 1.0, 2.0 } };
+        const metal::Gradient< double, 2 > v{ { p1, p2 }, { 3.0, 4.0 } };
+        const metal::Gradient< double, 1 > w{ { p3 }, { 5.0 } };
+
+        const auto before = heap_allocations();
+        const auto sum = u + v;
+        const auto result = metal::chain( u, 2.0, w, 3.0 );
+        REQUIRE( heap_allocations() == before );
+
+        STATIC_REQUIRE( std::is_same_v< decltype( sum ), const metal::Gradient< double, -1, 4 > > );
+        STATIC_REQUIRE( std::is_same_v< decltype( result ), const metal::Gradient< double, -1, 3 > > );
+        REQUIRE( sum.parameters() == metal::SmallVector< metal::Parameter, 4 >{ p1, p2 } );
+        REQUIRE( sum.value() == metal::SmallVector< double, 4 >{ 4.0, 6.0 } );
+        REQUIRE( result.value() == metal::SmallVector< double, 3 >{ 2.0, 4.0, 15.0 } );
+    }
+
+    SECTION( "Test dual number with gradient derivative" )
+    {
+        const metal::Dual< double, metal::Gradient< double, 1 > > u{ 2.0, { { p1 }, { 1.0 } } };
+        const metal::Dual< double, metal::Gradient< double, 1 > > v{ 3.0, { { p2 }, { 1.0 } } };
+        const auto w = u * v + sin( u );
+
+        REQUIRE( w.value() == 6.0 + std::sin( 2.0 ) );
+        REQUIRE( w.deriv().at( p1 ) == 3.0 + std::cos( 2.0 ) );
+        REQUIRE( w.deriv().at( p2 ) == 2.0 );
+    }
+}
+
+
+TEST_CASE( "Test indexed Gradient" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter p2{};
+    const metal::Parameter p3{};
+    const metal::Parameter missing{};
+
+    const auto index = std::make_shared< const metal::ParameterIndex >( std::vector< metal::Parameter >{ p3, p1 } );
+    REQUIRE( index->parameters() == std::vector< metal::Parameter >{ p1, p3 } );
+    REQUIRE( index->dense() );
+    REQUIRE( index->find( p2 ) == -1 );
+    REQUIRE( index->find( missing ) == -1 );
+
+    const metal::Gradient< double, 1 > sorted{ { p3 }, { 2.0 } };
+    metal::IndexedGradient< double > g{ index, sorted };
+    REQUIRE( g.at( p1 ) == 0.0 );
+    REQUIRE( g.at( p3 ) == 2.0 );
+
+    g[p1] = 1.5;
+    REQUIRE( g.values()[0] == 1.5 );
+    REQUIRE_THROWS_AS( g.at( p2 ), metal::ParameterNotFoundException );
+    REQUIRE_THROWS_AS( sorted.at( p1 ), metal::ParameterNotFoundException );
+
+    const auto back = g.gradient();
+    REQUIRE( back.parameters() == metal::SmallVector< metal::Parameter, 1 >{ p1, p3 } );
+    REQUIRE( back.value() == metal::SmallVector< double, 1 >{ 1.5, 2.0 } );
+}
+
+
+TEST_CASE( "Test indexed Gradient over parameters from several threads" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter missing{};
+    std::vector< metal::Parameter > parameters{ p1 };
+    const auto create = [&]( const int count )
+    {
+        std::vector< metal::Parameter > created( count );
+        parameters.push_back( created.back() );
+    };
+    // Each thread reserves its own block of ids, far from the ones of the main thread
+    std::thread( create, 1 ).join();
+    std::thread( create, 3 * static_cast< int >( metal::Parameter::BlockSize ) ).join();
+
+    const metal::ParameterIndex index{ parameters };
+    REQUIRE( index.parameters().back().id() - index.parameters().front().id() > 2 * metal::Parameter::BlockSize );
+    REQUIRE( !index.dense() );
+    REQUIRE( index.find( missing ) == -1 );
+    for ( int i = 0; i < index.size(); ++i )
+    {
+        REQUIRE( index.find( index.parameters()[i] ) == i );
+        REQUIRE( index.slot( index.parameters()[i] ) == i );
+    }
+
+    metal::IndexedGradient< double > g{ std::make_shared< const metal::ParameterIndex >( index ) };
+    g.at( parameters[2] ) = 2.0;
+    REQUIRE( g[parameters[2]] == 2.0 );
+    REQUIRE( g.at( p1 ) == 0.0 );
+    REQUIRE_THROWS_AS( g.at( missing ), metal::ParameterNotFoundException );
+}
@@ -2,6 +2,7 @@
 
 #include "metal/SmallVector.hpp"
 #include <array>
+#include <string>
 
 #include <catch2/catch_test_macros.hpp>
 
@@ -16,7 +17,8 @@ TEST_CASE( "Test default constructor" )
         REQUIRE( v.capacity() == 1 );
         REQUIRE( v.size() == 0 );
 
-        const int id = 1;
+        // Within capacity but beyond size, so only the unchecked access succeeds
+        const int id = 0;
         const int val = 2;
         v[id] = val;
         REQUIRE( v[id] == val );
@@ -29,3 +31,57 @@ TEST_CASE( "Test default constructor" )
         REQUIRE_THROWS( f() );
     }
 }
+
+
+TEST_CASE( "Test growth and element lifetime" )
+{
+    SECTION( "Test push back moves to the heap beyond the stack size" )
+    {
+        metal::SmallVector< int, 2 > v;
+        v.push_back( 1 );
+        v.push_back( 2 );
+        REQUIRE( v.is_inline() );
+
+        v.push_back( v[0] );
+        REQUIRE( !v.is_inline() );
+        REQUIRE( v.size() == 3 );
+        REQUIRE( v.capacity() == 4 );
+        REQUIRE( v == metal::SmallVector< int, 2 >{ 1, 2, 1 } );
+
+        v.reserve( 10 );
+        REQUIRE( v.capacity() == 10 );
+        v.resize( 1 );
+        REQUIRE( v == metal::SmallVector< int, 2 >{ 1 } );
+        REQUIRE( v.capacity() == 10 );
+    }
+
+    SECTION( "Test copy and move of inline and heap storage" )
+    {
+        metal::SmallVector< std::string, 2 > small{ "a", "b" };
+        metal::SmallVector< std::string, 2 > large{ "a", "b", "c" };
+        const auto* heap = large.data();
+
+        auto small_copy = small;
+        auto large_copy = large;
+        REQUIRE( small_copy == small );
+        REQUIRE( large_copy == large );
+        REQUIRE( large_copy.data() != heap );
+
+        const auto small_moved = std::move( small );
+        REQUIRE( small_moved.is_inline() );
+        REQUIRE( small_moved == small_copy );
+        REQUIRE( small.empty() );
+
+        const auto large_moved = std::move( large );
+        REQUIRE( large_moved.data() == heap );
+        REQUIRE( large.empty() );
+        REQUIRE( large.is_inline() );
+
+        small_copy = large_copy;
+        REQUIRE( small_copy == large_copy );
+        large_copy = std::move( small_copy );
+        REQUIRE( large_copy.size() == 3 );
+        large_copy.pop_back();
+        REQUIRE( large_copy.back() == "b" );
+    }
+}
@@ -0,0 +1,100 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Tape.hpp"
+#include "metal/Hessian.hpp"
+
+#include <cmath>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+
+TEST_CASE( "Test tape gradient" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter p2{};
+
+    metal::Tape tape;
+    const auto x = tape.variable( p1, 1.5 );
+    const auto y = tape.variable( p2, 2.0 );
+    const auto z = x * y + sin( x ) / y - sqrt( cube( x ) ) + 2.0 / square( y );
+
+    const auto gradient = tape.gradient( z );
+    REQUIRE( gradient.parameters() == metal::SmallVector< metal::Parameter, 1 >{ p1, p2 } );
+    const double dzdx = 2.0 + std::cos( 1.5 ) / 2.0 - 1.5 * std::sqrt( 1.5 );
+    const double dzdy = 1.5 - std::sin( 1.5 ) / 4.0 - 4.0 / 8.0;
+    REQUIRE_THAT( gradient.at( p1 ), Catch::Matchers::WithinRel( dzdx, 1e-14 ) );
+    REQUIRE_THAT( gradient.at( p2 ), Catch::Matchers::WithinRel( dzdy, 1e-14 ) );
+
+    metal::Tape other;
+    REQUIRE_THROWS( x + other.variable( p1, 1.0 ) );
+}
+
+
+TEST_CASE( "Test tape checkpointing" )
+{
+    const metal::Parameter p{};
+    const metal::Parameter q{};
+    constexpr int steps = 100;
+
+    // Iterate x <- x + h * sin( x * a ), recording every step or only the step outputs
+    const auto step = []( std::span< const metal::Active > state )
+    {
+        return std::vector< metal::Active >{ state[0] + 0.01 * sin( state[0] * state[1] ), state[1] };
+    };
+
+    metal::Tape full;
+    std::vector< metal::Active > state{ full.variable( p, 0.5 ), full.variable( q, 1.2 ) };
+    for ( int i = 0; i < steps; ++i )
+    {
+        state = step( state );
+    }
+    const auto expected = full.gradient( state[0] );
+
+    metal::Tape tape;
+    std::vector< metal::Active > checkpointed{ tape.variable( p, 0.5 ), tape.variable( q, 1.2 ) };
+    for ( int i = 0; i < steps; ++i )
+    {
+        checkpointed = tape.checkpoint( checkpointed, step );
+    }
+    const auto gradient = tape.gradient( square( checkpointed[0] ) );
+
+    REQUIRE( tape.size() < full.size() );
+    REQUIRE( checkpointed[0].value() == state[0].value() );
+    const double scale = 2 * state[0].value();
+    REQUIRE_THAT( gradient.at( p ), Catch::Matchers::WithinRel( scale * expected.at( p ), 1e-12 ) );
+    REQUIRE_THAT( gradient.at( q ), Catch::Matchers::WithinRel( scale * expected.at( q ), 1e-12 ) );
+}
+
+
+TEST_CASE( "Test Hessian of a function of runtime parameters" )
+{
+    const metal::Parameter p1{};
+    const metal::Parameter p2{};
+    const metal::Parameter p3{};
+
+    const auto f = []( const auto x ) { return x[1] * x[0] + sin( x[1] ) / x[0] + 2.0 * square( x[2] ) * x[1]; };
+    const metal::Parameter parameters[] = { p2, p1, p3 };
+    const double values[] = { 1.5, 2.0, 0.5 };
+    const auto result = metal::hessian( f, parameters, values );
+
+    // Parameters are sorted, x = 2.0 for p1, y = 1.5 for p2 and z = 0.5 for p3
+    const double x = 2.0;
+    const double y = 1.5;
+    const double z = 0.5;
+    REQUIRE( result.parameters() == metal::SmallVector< metal::Parameter, 1 >{ p1, p2, p3 } );
+    REQUIRE_THAT( result.value(), Catch::Matchers::WithinRel( x * y + std::sin( x ) / y + 2 * z * z * x, 1e-14 ) );
+    REQUIRE_THAT( result.gradient().at( p1 ), Catch::Matchers::WithinRel( y + std::cos( x ) / y + 2 * z * z, 1e-14 ) );
+    REQUIRE_THAT( result.gradient().at( p3 ), Catch::Matchers::WithinRel( 4 * z * x, 1e-14 ) );
+
+    REQUIRE( result.packed().size() == 6 );
+    REQUIRE_THAT( result.at( p1, p1 ), Catch::Matchers::WithinRel( -std::sin( x ) / y, 1e-14 ) );
+    REQUIRE_THAT( result.at( p1, p2 ), Catch::Matchers::WithinRel( 1 - std::cos( x ) / ( y * y ), 1e-14 ) );
+    REQUIRE_THAT( result.at( p2, p1 ), Catch::Matchers::WithinRel( 1 - std::cos( x ) / ( y * y ), 1e-14 ) );
+    REQUIRE_THAT( result.at( p2, p2 ), Catch::Matchers::WithinRel( 2 * std::sin( x ) / ( y * y * y ), 1e-14 ) );
+    REQUIRE_THAT( result.at( p1, p3 ), Catch::Matchers::WithinRel( 4 * z, 1e-14 ) );
+    REQUIRE_THAT( result.at( p3, p3 ), Catch::Matchers::WithinRel( 4 * x, 1e-14 ) );
+    REQUIRE( result( 2, 1 ) == 0.0 );
+
+    const metal::Parameter missing{};
+    REQUIRE_THROWS_AS( result.at( p1, missing ), metal::ParameterNotFoundException );
+}
@@ -0,0 +1,73 @@
+/** Copyright Gabor Varga 2023 */
+
+#include "metal/Core.hpp"
+#include "metal/Taylor.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+
+TEST_CASE( "Test Taylor series arithmetic" )
+{
+    using Series = metal::Taylor< double, 4 >;
+
+    SECTION( "Test polynomial" )
+    {
+        const auto x = Series::variable( 2.0 );
+        const auto y = 3 * x * x * x - x / 2 + 1.0;
+
+        REQUIRE( y.deriv( 0 ) == 24.0 );
+        REQUIRE( y.deriv( 1 ) == 35.5 );
+        REQUIRE( y.deriv( 2 ) == 36.0 );
+        REQUIRE( y.deriv( 3 ) == 18.0 );
+        REQUIRE( y.deriv( 4 ) == 0.0 );
+    }
+
+    SECTION( "Test division and square root" )
+    {
+        const double x0 = 1.5;
+        const auto x = Series::variable( x0 );
+        const auto y = 1.0 / x;
+        const auto z = sqrt( x );
+
+        REQUIRE_THAT( y.deriv( 3 ), Catch::Matchers::WithinRel( -6.0 / std::pow( x0, 4 ), 1e-14 ) );
+        REQUIRE_THAT( z.deriv( 2 ), Catch::Matchers::WithinRel( -0.25 * std::pow( x0, -1.5 ), 1e-14 ) );
+        REQUIRE_THAT( ( z * z ).deriv( 1 ), Catch::Matchers::WithinRel( 1.0, 1e-14 ) );
+    }
+}
+
+
+TEST_CASE( "Test Taylor series through expressions" )
+{
+    SECTION( "Test high order derivatives of sine" )
+    {
+        const metal::Variable< "x", double > x;
+        const auto y = sin( x );
+
+        const double x0 = 1.0;
+        const auto series = y.eval( metal::Bindings{ metal::bind< "x" >( metal::Taylor< double, 4 >::variable( x0 ) ) } );
+
+        REQUIRE_THAT( series.deriv( 0 ), Catch::Matchers::WithinRel( std::sin( x0 ), 1e-15 ) );
+        REQUIRE_THAT( series.deriv( 1 ), Catch::Matchers::WithinRel( std::cos( x0 ), 1e-15 ) );
+        REQUIRE_THAT( series.deriv( 2 ), Catch::Matchers::WithinRel( -std::sin( x0 ), 1e-15 ) );
+        REQUIRE_THAT( series.deriv( 3 ), Catch::Matchers::WithinRel( -std::cos( x0 ), 1e-15 ) );
+        REQUIRE_THAT( series.deriv( 4 ), Catch::Matchers::WithinRel( std::sin( x0 ), 1e-15 ) );
+    }
+
+    SECTION( "Test matches nested symbolic derivatives" )
+    {
+        DOUBLE( x, 1.2 );
+        DOUBLE( y, 2.0 );
+        const auto z = metal::TwoPi{} * sqrt( cube( x ) / y ) + cos( x ) * y;
+        const auto d1 = diff( z, x );
+        const auto d2 = diff( d1, x );
+        const auto d3 = diff( d2, x );
+
+        const auto series = z.eval( metal::Bindings{ metal::bind< "x" >( metal::Taylor< double, 3 >::variable( 1.2 ) ) } );
+
+        REQUIRE_THAT( series.deriv( 0 ), Catch::Matchers::WithinRel( z.eval(), 1e-14 ) );
+        REQUIRE_THAT( series.deriv( 1 ), Catch::Matchers::WithinRel( d1.eval(), 1e-14 ) );
+        REQUIRE_THAT( series.deriv( 2 ), Catch::Matchers::WithinRel( d2.eval(), 1e-14 ) );
+        REQUIRE_THAT( series.deriv( 3 ), Catch::Matchers::WithinRel( d3.eval(), 1e-13 ) );
+    }
+}